@@ -0,0 +1,172 @@
+// Measure the spawn latency (the time the parent spends in `run`) and the spawn throughput
+// as a function of the resident set size of the parent.
+//
+// Usage: spawn [iterations] [rss_mb ...]
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <pqrs/process.hpp>
+#include <string>
+#include <string_view>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+using clock = std::chrono::steady_clock;
+
+struct result final {
+  double spawns_per_second;
+  double p50_us;
+  double p99_us;
+};
+
+// `spawn` returns the time spent in spawning, and waits for the child process after that.
+result measure(int iterations, std::function<clock::duration()> spawn) {
+  std::vector<double> latencies;
+  latencies.reserve(iterations);
+
+  const auto start = clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    latencies.push_back(std::chrono::duration<double, std::micro>(spawn()).count());
+  }
+  const auto elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+  std::ranges::sort(latencies);
+
+  return result{
+      iterations / elapsed,
+      latencies[latencies.size() / 2],
+      latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)],
+  };
+}
+
+clock::duration spawn_process(std::shared_ptr<pqrs::dispatcher::dispatcher> dispatcher,
+                              bool fast_spawn) {
+  pqrs::process::process p(dispatcher,
+                           std::vector<std::string>{
+                               "/bin/true",
+                           });
+  if (fast_spawn) {
+    p.enable_fast_spawn();
+  }
+
+  const auto start = clock::now();
+  p.run();
+  const auto duration = clock::now() - start;
+
+  p.wait();
+
+  return duration;
+}
+
+// The reference which copies the page tables.
+clock::duration spawn_fork() {
+  const auto start = clock::now();
+  const auto pid = fork();
+  if (pid == 0) {
+    execl("/bin/true", "/bin/true", nullptr);
+    _exit(127);
+  }
+  const auto duration = clock::now() - start;
+
+  int status;
+  waitpid(pid, &status, 0);
+
+  return duration;
+}
+
+std::optional<size_t> parse_number(std::string_view s) {
+  size_t value = 0;
+  const auto [end, error] = std::from_chars(s.data(), s.data() + s.size(), value);
+  if (error != std::errc() || end != s.data() + s.size()) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+int usage(int exit_code) {
+  (exit_code == 0 ? std::cout : std::cerr) << "Usage: spawn [iterations] [rss_mb ...]" << std::endl;
+  return exit_code;
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  std::vector<size_t> numbers;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view argument(argv[i]);
+    if (argument == "-h" || argument == "--help") {
+      return usage(0);
+    }
+
+    const auto n = parse_number(argument);
+    if (!n) {
+      std::cerr << "spawn: invalid number: " << argument << std::endl;
+      return usage(1);
+    }
+    numbers.push_back(*n);
+  }
+
+  const int iterations = numbers.empty() ? 200 : static_cast<int>(numbers.front());
+  if (iterations <= 0) {
+    std::cerr << "spawn: iterations must be positive" << std::endl;
+    return usage(1);
+  }
+
+  std::vector<size_t> rss_mbs;
+  if (numbers.size() > 1) {
+    rss_mbs.assign(std::begin(numbers) + 1, std::end(numbers));
+  }
+  if (rss_mbs.empty()) {
+    rss_mbs = {0, 256, 1024, 2048};
+  }
+
+  auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+  auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+  std::cout << std::setw(8) << "rss_mb"
+            << std::setw(14) << "mode"
+            << std::setw(12) << "spawns/s"
+            << std::setw(12) << "p50_us"
+            << std::setw(12) << "p99_us"
+            << std::endl;
+
+  std::vector<char> memory;
+
+  for (const auto rss_mb : rss_mbs) {
+    // Touch every page so that it is resident.
+    memory.clear();
+    memory.shrink_to_fit();
+    memory.resize(rss_mb * 1024 * 1024);
+    memset(memory.data(), 1, memory.size());
+
+    const std::vector<std::pair<std::string, std::function<clock::duration()>>> modes{
+        {"posix_spawn", [&] { return spawn_process(dispatcher, false); }},
+        {"fast_spawn", [&] { return spawn_process(dispatcher, true); }},
+        {"fork", [] { return spawn_fork(); }},
+    };
+
+    for (const auto& [name, spawn] : modes) {
+      const auto r = measure(iterations, spawn);
+
+      std::cout << std::setw(8) << rss_mb
+                << std::setw(14) << name
+                << std::fixed << std::setprecision(1)
+                << std::setw(12) << r.spawns_per_second
+                << std::setw(12) << r.p50_us
+                << std::setw(12) << r.p99_us
+                << std::endl;
+    }
+  }
+
+  dispatcher->terminate();
+  dispatcher = nullptr;
+
+  return 0;
+}
@@ -0,0 +1,63 @@
+// The child process of the benchmarks.
+//
+// generator bytes <size>                Write <size> bytes to stdout.
+// generator ping <count> <interval_us>  Write the current time (steady_clock, nanoseconds) as a line <count> times.
+// generator exit                        Write the current time as a line and exit immediately.
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+void write_all(const char* data, size_t size) {
+  while (size > 0) {
+    const auto n = write(STDOUT_FILENO, data, size);
+    if (n <= 0) {
+      _exit(1);
+    }
+    data += n;
+    size -= n;
+  }
+}
+
+void write_now() {
+  const auto now = std::chrono::steady_clock::now().time_since_epoch();
+  const auto line = std::to_string(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()) + "\n";
+  write_all(line.data(), line.size());
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  const std::string mode = argc > 1 ? argv[1] : "";
+
+  if (mode == "bytes" && argc > 2) {
+    auto size = std::stoull(argv[2]);
+    const std::vector<char> chunk(64 * 1024, 'x');
+    while (size > 0) {
+      const auto n = std::min<size_t>(size, chunk.size());
+      write_all(chunk.data(), n);
+      size -= n;
+    }
+    return 0;
+  }
+
+  if (mode == "ping" && argc > 3) {
+    const auto count = std::stoi(argv[2]);
+    const auto interval = std::chrono::microseconds(std::stoi(argv[3]));
+    for (int i = 0; i < count; ++i) {
+      write_now();
+      std::this_thread::sleep_for(interval);
+    }
+    return 0;
+  }
+
+  if (mode == "exit") {
+    write_now();
+    _exit(0);
+  }
+
+  return 1;
+}
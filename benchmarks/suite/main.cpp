@@ -0,0 +1,343 @@
+// Benchmarks of the hot paths. The results are written to stdout as JSON.
+//
+// Usage: suite [iterations]
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <pqrs/process.hpp>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <sys/utsname.h>
+#include <vector>
+
+namespace {
+using clock = std::chrono::steady_clock;
+
+int64_t now_nanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+}
+
+double percentile(std::vector<double> values, size_t p) {
+  if (values.empty()) {
+    return 0;
+  }
+
+  std::ranges::sort(values);
+  return values[std::min(values.size() - 1, values.size() * p / 100)];
+}
+
+class report final {
+public:
+  void add_value(const std::string& name,
+                 const std::string& unit,
+                 size_t iterations,
+                 double value) {
+    std::ostringstream s;
+    s << "{\"name\": \"" << name << "\", "
+      << "\"unit\": \"" << unit << "\", "
+      << "\"iterations\": " << iterations << ", "
+      << "\"value\": " << value << "}";
+    entries_.push_back(s.str());
+  }
+
+  void add_distribution(const std::string& name,
+                        const std::string& unit,
+                        const std::vector<double>& values) {
+    std::ostringstream s;
+    s << "{\"name\": \"" << name << "\", "
+      << "\"unit\": \"" << unit << "\", "
+      << "\"iterations\": " << values.size() << ", "
+      << "\"p50\": " << percentile(values, 50) << ", "
+      << "\"p99\": " << percentile(values, 99) << ", "
+      << "\"max\": " << percentile(values, 100) << "}";
+    entries_.push_back(s.str());
+  }
+
+  void write(std::ostream& stream) const {
+    utsname u{};
+    uname(&u);
+
+    stream << "{" << std::endl
+           << "  \"system\": \"" << u.sysname << " " << u.release << " " << u.machine << "\"," << std::endl
+           << "  \"benchmarks\": [" << std::endl;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      stream << "    " << entries_[i] << (i + 1 < entries_.size() ? "," : "") << std::endl;
+    }
+    stream << "  ]" << std::endl
+           << "}" << std::endl;
+  }
+
+private:
+  std::vector<std::string> entries_;
+};
+
+// Run a process and wait for `exited`.
+void run(pqrs::process::process& p) {
+  const auto wait = pqrs::make_thread_wait();
+  p.exited.connect([wait](auto&&) {
+    wait->notify();
+  });
+  p.run_failed.connect([wait] {
+    wait->notify();
+  });
+  p.run();
+  p.wait();
+  wait->wait_notice();
+}
+
+// Spawn `/bin/true` and wait for it.
+void spawn_rate(report& r,
+                std::shared_ptr<pqrs::dispatcher::dispatcher> dispatcher,
+                size_t iterations) {
+  const auto start = clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    pqrs::process::process p(dispatcher,
+                             std::vector<std::string>{
+                                 "/bin/true",
+                             });
+    run(p);
+  }
+  const auto elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+  r.add_value("spawn_rate", "spawns/s", iterations, iterations / elapsed);
+}
+
+// Read the output of the generator through `stdout_buffer_received`.
+// `tuned` enlarges the pipe and reads with `enable_adaptive_read`.
+void stdout_throughput(report& r,
+                       std::shared_ptr<pqrs::dispatcher::dispatcher> dispatcher,
+                       const std::string& generator,
+                       bool tuned) {
+  constexpr size_t size = 256 * 1024 * 1024;
+
+  size_t received = 0;
+  pqrs::process::process p(dispatcher,
+                           std::vector<std::string>{
+                               generator,
+                               "bytes",
+                               std::to_string(size),
+                           });
+  if (tuned) {
+    p.set_pipe_size(1024 * 1024);
+    p.enable_adaptive_read(16);
+  }
+  p.stdout_buffer_received.connect([&received](auto&& buffer) {
+    received += buffer->size();
+  });
+
+  const auto start = clock::now();
+  run(p);
+  const auto elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+  r.add_value(tuned ? "stdout_throughput_tuned" : "stdout_throughput", "MiB/s", 1, received / elapsed / (1024 * 1024));
+}
+
+// The time from the write in the child process to `stdout_line_received`.
+void stdout_latency(report& r,
+                    std::shared_ptr<pqrs::dispatcher::dispatcher> dispatcher,
+                    const std::string& generator,
+                    size_t iterations) {
+  std::vector<double> latencies;
+  pqrs::process::process p(dispatcher,
+                           std::vector<std::string>{
+                               generator,
+                               "ping",
+                               std::to_string(iterations),
+                               "1000",
+                           });
+  p.enable_line_framing();
+  p.stdout_line_received.connect([&latencies](auto&& line) {
+    const auto now = now_nanoseconds();
+    latencies.push_back((now - std::stoll(std::string(line))) / 1000.0);
+  });
+  run(p);
+
+  r.add_distribution("stdout_latency", "us", latencies);
+}
+
+// The same as `stdout_latency` with `enable_inline_delivery`.
+void stdout_latency_inline(report& r,
+                           std::shared_ptr<pqrs::dispatcher::dispatcher> dispatcher,
+                           const std::string& generator,
+                           size_t iterations) {
+  std::vector<double> latencies;
+  latencies.reserve(iterations);
+  pqrs::process::process p(dispatcher,
+                           std::vector<std::string>{
+                               generator,
+                               "ping",
+                               std::to_string(iterations),
+                               "1000",
+                           });
+  p.enable_inline_delivery({
+      .stdout_received = [&latencies](auto&& data) {
+        const auto now = now_nanoseconds();
+        std::string_view s(reinterpret_cast<const char*>(data.data()), data.size());
+        while (!s.empty()) {
+          const auto pos = std::min(s.find('\n'), s.size());
+          latencies.push_back((now - std::stoll(std::string(s.substr(0, pos)))) / 1000.0);
+          s.remove_prefix(std::min(pos + 1, s.size()));
+        }
+      },
+  });
+  run(p);
+
+  r.add_distribution("stdout_latency_inline", "us", latencies);
+}
+
+// The time from the exit of the child process to `exited`.
+void exit_latency(report& r,
+                  std::shared_ptr<pqrs::dispatcher::dispatcher> dispatcher,
+                  const std::string& generator,
+                  size_t iterations) {
+  std::vector<double> latencies;
+  for (size_t i = 0; i < iterations; ++i) {
+    int64_t written = 0;
+    pqrs::process::process p(dispatcher,
+                             std::vector<std::string>{
+                                 generator,
+                                 "exit",
+                             });
+    p.enable_line_framing();
+    p.stdout_line_received.connect([&written](auto&& line) {
+      written = std::stoll(std::string(line));
+    });
+    p.exited.connect([&latencies, &written](auto&&) {
+      latencies.push_back((now_nanoseconds() - written) / 1000.0);
+    });
+    run(p);
+  }
+
+  r.add_distribution("exit_latency", "us", latencies);
+}
+
+// Capture the output of the generator into a string in the way `execute` did before output sinks
+// (appending each byte to a std::stringstream and copying it out with `str`),
+// and with `execute` and its default string sink.
+void capture_throughput(report& r,
+                        const std::string& generator) {
+  constexpr size_t size = 64 * 1024 * 1024;
+  const std::vector<std::string> argv{
+      generator,
+      "bytes",
+      std::to_string(size),
+  };
+
+  {
+    const auto start = clock::now();
+    std::string captured;
+    {
+      auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+      auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+      std::stringstream stream;
+      {
+        pqrs::process::process p(dispatcher, argv);
+        p.stdout_received.connect([&stream](auto&& buffer) {
+          for (const auto& c : *buffer) {
+            stream << c;
+          }
+        });
+        run(p);
+      }
+      captured = stream.str();
+
+      dispatcher->terminate();
+      dispatcher = nullptr;
+    }
+    const auto elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+    r.add_value("capture_stringstream", "MiB/s", 1, captured.size() / elapsed / (1024 * 1024));
+  }
+
+  {
+    const auto start = clock::now();
+    std::string captured;
+    {
+      pqrs::process::execute e(argv);
+      captured = e.take_stdout();
+    }
+    const auto elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+    r.add_value("capture_string_sink", "MiB/s", 1, captured.size() / elapsed / (1024 * 1024));
+  }
+}
+
+// `execute` of `/bin/true`, including the creation of its dispatcher.
+void execute_latency(report& r,
+                     size_t iterations) {
+  std::vector<double> latencies;
+  for (size_t i = 0; i < iterations; ++i) {
+    const auto start = clock::now();
+    {
+      pqrs::process::execute e(std::vector<std::string>{
+          "/bin/true",
+      });
+    }
+    latencies.push_back(std::chrono::duration<double, std::micro>(clock::now() - start).count());
+  }
+
+  r.add_distribution("execute_latency", "us", latencies);
+}
+
+std::optional<size_t> parse_number(std::string_view s) {
+  size_t value = 0;
+  const auto [end, error] = std::from_chars(s.data(), s.data() + s.size(), value);
+  if (error != std::errc() || end != s.data() + s.size()) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+int usage(int exit_code) {
+  (exit_code == 0 ? std::cout : std::cerr) << "Usage: suite [iterations]" << std::endl;
+  return exit_code;
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  size_t iterations = 200;
+  if (argc > 2) {
+    return usage(1);
+  }
+  if (argc > 1) {
+    const std::string_view argument(argv[1]);
+    if (argument == "-h" || argument == "--help") {
+      return usage(0);
+    }
+
+    const auto n = parse_number(argument);
+    if (!n || *n == 0) {
+      std::cerr << "suite: invalid iterations: " << argument << std::endl;
+      return usage(1);
+    }
+    iterations = *n;
+  }
+
+  const auto generator = (std::filesystem::absolute(argv[0]).parent_path() / "generator").string();
+
+  auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+  auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+  report r;
+  spawn_rate(r, dispatcher, iterations);
+  stdout_throughput(r, dispatcher, generator, false);
+  stdout_throughput(r, dispatcher, generator, true);
+  stdout_latency(r, dispatcher, generator, iterations);
+  stdout_latency_inline(r, dispatcher, generator, iterations);
+  exit_latency(r, dispatcher, generator, iterations);
+  execute_latency(r, iterations);
+  capture_throughput(r, generator);
+
+  dispatcher->terminate();
+  dispatcher = nullptr;
+
+  r.write(std::cout);
+
+  return 0;
+}
@@ -6,8 +6,13 @@
 // Distributed under the Boost Software License, Version 1.0.
 // (See https://www.boost.org/LICENSE_1_0.txt)
 
+#include "process/async_execute.hpp"
+#include "process/coprocess.hpp"
 #include "process/execute.hpp"
+#include "process/execute_many.hpp"
+#include "process/pipeline.hpp"
 #include "process/process.hpp"
+#include "process/process_reader.hpp"
 #include <cstdlib>
 #include <optional>
 #include <string>
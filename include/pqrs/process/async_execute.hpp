@@ -0,0 +1,132 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+#include "execute.hpp"
+#include "execute_result.hpp"
+#include "executor.hpp"
+#include "process.hpp"
+#include <coroutine>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pqrs::process {
+// An awaitable version of `execute`.
+//
+//   auto result = co_await pqrs::process::async_execute(dispatcher, {"/bin/echo", "hello"});
+//
+// The process is run when the coroutine is suspended, and the coroutine is resumed after the process has exited.
+// It is resumed on the dispatcher thread, or through `resume_executor` if it is given.
+// Set `execute_options::reactor` to await many commands without a polling thread per process.
+//
+// The coroutine is never resumed if the dispatcher is terminated before the process exits.
+class async_execute final : public dispatcher::extra::dispatcher_client {
+public:
+  async_execute(std::weak_ptr<dispatcher::dispatcher> weak_dispatcher,
+                const std::vector<std::string>& argv,
+                execute_options options = {},
+                executor resume_executor = nullptr)
+      : async_execute(std::move(weak_dispatcher),
+                      std::make_shared<command_spec>(argv),
+                      std::move(options),
+                      std::move(resume_executor)) {
+  }
+
+  async_execute(std::weak_ptr<dispatcher::dispatcher> weak_dispatcher,
+                std::shared_ptr<const command_spec> spec,
+                execute_options options = {},
+                executor resume_executor = nullptr)
+      : dispatcher_client(weak_dispatcher),
+        process_(std::make_unique<process>(weak_dispatcher, std::move(spec))),
+        options_(std::move(options)),
+        resume_executor_(std::move(resume_executor)) {
+  }
+
+  ~async_execute() override {
+    detach_from_dispatcher();
+
+    // Destroy the process before the members which its signal handlers use.
+    process_ = nullptr;
+  }
+
+  async_execute(const async_execute&) = delete;
+  async_execute(async_execute&&) = delete;
+  async_execute& operator=(const async_execute&) = delete;
+  async_execute& operator=(async_execute&&) = delete;
+
+  [[nodiscard]] bool await_ready() const noexcept {
+    return false;
+  }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+
+    process_->stdout_buffer_received.connect([this](auto&& buffer) {
+      options_.stdout_sink.write(buffer->get_span());
+    });
+    process_->stderr_buffer_received.connect([this](auto&& buffer) {
+      options_.stderr_sink.write(buffer->get_span());
+    });
+    process_->exited_with_usage.connect([this](auto&&, auto&& usage) {
+      result_.resource_usage_ = usage;
+    });
+    process_->exited.connect([this](auto&& status) {
+      result_.exit_code_ = WIFEXITED(status) ? std::optional<int>(WEXITSTATUS(status)) : std::nullopt;
+      result_.timed_out_ = process_->get_timed_out();
+
+      // The coroutine may destroy this object, so resume it after `exited` returns.
+      enqueue_to_dispatcher([this] {
+        resume();
+      });
+    });
+
+    if (options_.fast_spawn) {
+      process_->enable_fast_spawn();
+    }
+    if (options_.reactor) {
+      process_->set_reactor(options_.reactor);
+    }
+    if (options_.deadline) {
+      process_->set_deadline(*options_.deadline,
+                             options_.deadline_signal,
+                             options_.deadline_grace_period);
+    }
+
+    if (!process_->run()) {
+      // Resume the coroutine immediately.
+      result_.run_failed_ = true;
+      return false;
+    }
+
+    return true;
+  }
+
+  [[nodiscard]] execute_result await_resume() {
+    result_.stdout_ = options_.stdout_sink.take();
+    result_.stderr_ = options_.stderr_sink.take();
+    return std::move(result_);
+  }
+
+private:
+  // This method is called on the dispatcher thread.
+  void resume() {
+    if (resume_executor_) {
+      resume_executor_([handle = handle_] {
+        handle.resume();
+      });
+    } else {
+      handle_.resume();
+    }
+  }
+
+  std::unique_ptr<process> process_;
+  execute_options options_;
+  executor resume_executor_;
+  std::coroutine_handle<> handle_;
+  execute_result result_;
+};
+} // namespace pqrs::process
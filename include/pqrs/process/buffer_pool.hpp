@@ -0,0 +1,317 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+// `pqrs::process::buffer_pool` can be used safely in a multi-threaded environment.
+// `pqrs::process::buffer` can be read from multiple threads once it is delivered.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace pqrs::process {
+namespace impl {
+// Counts the buffers which have been delivered but not released yet.
+// The bytes are the capacities of the buffers, which is the memory they hold regardless of how much of it is used.
+// The producer pauses when the total reaches a limit, and is resumed through `resume_handler` once the consumers release enough buffers.
+class in_flight_counter final {
+public:
+  void add(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    bytes_ += bytes;
+    ++chunks_;
+  }
+
+  void release(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    bytes_ -= bytes;
+    --chunks_;
+
+    if (resume_threshold_ && bytes_ <= *resume_threshold_) {
+      resume_threshold_ = std::nullopt;
+      if (resume_handler_) {
+        // Called with `mutex_` locked, so that `set_resume_handler(nullptr)` waits for the running handler.
+        resume_handler_();
+      }
+    }
+  }
+
+  // Returns true if the total is `limit` or more.
+  // In that case, `resume_handler` is called once the total falls to `resume_threshold` or less.
+  bool pause_if_exceeded(size_t limit,
+                         size_t resume_threshold) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (bytes_ < limit) {
+      return false;
+    }
+
+    resume_threshold_ = resume_threshold;
+    return true;
+  }
+
+  // `handler` is called on the thread which releases a buffer. It must not block.
+  void set_resume_handler(std::function<void()> handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    resume_handler_ = std::move(handler);
+  }
+
+  [[nodiscard]] size_t get_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return bytes_;
+  }
+
+  [[nodiscard]] size_t get_chunks() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return chunks_;
+  }
+
+private:
+  size_t bytes_ = 0;
+  size_t chunks_ = 0;
+  std::optional<size_t> resume_threshold_;
+  std::function<void()> resume_handler_;
+  mutable std::mutex mutex_;
+};
+
+// The free lists are shared by the pool and the buffers, so that buffers can outlive the pool.
+class buffer_pool_state final {
+public:
+  buffer_pool_state(size_t block_size,
+                    size_t max_free_blocks)
+      : block_size_(block_size),
+        max_free_blocks_(max_free_blocks) {
+  }
+
+  ~buffer_pool_state() {
+    for (auto&& s : free_slots_) {
+      ::operator delete(s);
+    }
+  }
+
+  buffer_pool_state(const buffer_pool_state&) = delete;
+  buffer_pool_state(buffer_pool_state&&) = delete;
+  buffer_pool_state& operator=(const buffer_pool_state&) = delete;
+  buffer_pool_state& operator=(buffer_pool_state&&) = delete;
+
+  [[nodiscard]] size_t get_block_size() const noexcept {
+    return block_size_;
+  }
+
+  std::unique_ptr<uint8_t[]> take_block() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      if (!free_blocks_.empty()) {
+        auto b = std::move(free_blocks_.back());
+        free_blocks_.pop_back();
+        return b;
+      }
+    }
+
+    return std::make_unique_for_overwrite<uint8_t[]>(block_size_);
+  }
+
+  void give_block(std::unique_ptr<uint8_t[]> block) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (free_blocks_.size() < max_free_blocks_) {
+      free_blocks_.push_back(std::move(block));
+    }
+  }
+
+  // Slots hold the `std::shared_ptr` control block and the `buffer` object.
+
+  void* take_slot(size_t size) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      if (slot_size_ == 0) {
+        slot_size_ = size;
+      }
+
+      if (size == slot_size_ && !free_slots_.empty()) {
+        auto s = free_slots_.back();
+        free_slots_.pop_back();
+        return s;
+      }
+    }
+
+    return ::operator new(size);
+  }
+
+  void give_slot(void* slot, size_t size) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      if (size == slot_size_ && free_slots_.size() < max_free_blocks_) {
+        free_slots_.push_back(slot);
+        return;
+      }
+    }
+
+    ::operator delete(slot);
+  }
+
+private:
+  const size_t block_size_;
+  const size_t max_free_blocks_;
+
+  std::vector<std::unique_ptr<uint8_t[]>> free_blocks_;
+  std::vector<void*> free_slots_;
+  size_t slot_size_ = 0;
+  std::mutex mutex_;
+};
+
+template <typename T>
+class buffer_pool_allocator final {
+public:
+  using value_type = T;
+
+  explicit buffer_pool_allocator(std::shared_ptr<buffer_pool_state> state) noexcept
+      : state_(std::move(state)) {
+  }
+
+  template <typename U>
+  buffer_pool_allocator(const buffer_pool_allocator<U>& other) noexcept
+      : state_(other.state_) {
+  }
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(state_->take_slot(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+    state_->give_slot(p, n * sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(const buffer_pool_allocator<U>& other) const noexcept {
+    return state_ == other.state_;
+  }
+
+private:
+  template <typename U>
+  friend class buffer_pool_allocator;
+
+  std::shared_ptr<buffer_pool_state> state_;
+};
+} // namespace impl
+
+// A chunk of bytes read from a pipe.
+// The storage is returned to the pool when the last reference is dropped.
+class buffer final {
+public:
+  explicit buffer(std::shared_ptr<impl::buffer_pool_state> state)
+      : state_(std::move(state)),
+        storage_(state_->take_block()),
+        capacity_(state_->get_block_size()),
+        size_(0) {
+  }
+
+  ~buffer() {
+    if (in_flight_counter_) {
+      in_flight_counter_->release(capacity_);
+    }
+
+    state_->give_block(std::move(storage_));
+  }
+
+  buffer(const buffer&) = delete;
+  buffer(buffer&&) = delete;
+  buffer& operator=(const buffer&) = delete;
+  buffer& operator=(buffer&&) = delete;
+
+  [[nodiscard]] const uint8_t* data() const noexcept {
+    return storage_.get();
+  }
+
+  [[nodiscard]] size_t size() const noexcept {
+    return size_;
+  }
+
+  [[nodiscard]] bool empty() const noexcept {
+    return size_ == 0;
+  }
+
+  [[nodiscard]] size_t capacity() const noexcept {
+    return capacity_;
+  }
+
+  [[nodiscard]] const uint8_t* begin() const noexcept {
+    return data();
+  }
+
+  [[nodiscard]] const uint8_t* end() const noexcept {
+    return data() + size_;
+  }
+
+  [[nodiscard]] std::span<const uint8_t> get_span() const noexcept {
+    return std::span<const uint8_t>(data(), size_);
+  }
+
+  // The following methods are used by the producer before the buffer is shared.
+
+  [[nodiscard]] uint8_t* get_writable_data() noexcept {
+    return storage_.get();
+  }
+
+  void set_size(size_t value) noexcept {
+    size_ = std::min(value, capacity_);
+  }
+
+  // Count the capacity of this buffer in `counter` until it is released.
+  void set_in_flight_counter(std::shared_ptr<impl::in_flight_counter> counter) {
+    counter->add(capacity_);
+    in_flight_counter_ = std::move(counter);
+  }
+
+private:
+  std::shared_ptr<impl::buffer_pool_state> state_;
+  std::shared_ptr<impl::in_flight_counter> in_flight_counter_;
+  std::unique_ptr<uint8_t[]> storage_;
+  size_t capacity_;
+  size_t size_;
+};
+
+// Recycles fixed-size blocks (and the `std::shared_ptr` control blocks which own them)
+// so that reading a chunk does not allocate in the steady state.
+class buffer_pool final {
+public:
+  explicit buffer_pool(size_t block_size = 32 * 1024,
+                       size_t max_free_blocks = 64)
+      : state_(std::make_shared<impl::buffer_pool_state>(block_size, max_free_blocks)) {
+  }
+
+  buffer_pool(const buffer_pool&) = delete;
+  buffer_pool(buffer_pool&&) = delete;
+  buffer_pool& operator=(const buffer_pool&) = delete;
+  buffer_pool& operator=(buffer_pool&&) = delete;
+
+  [[nodiscard]] size_t get_block_size() const noexcept {
+    return state_->get_block_size();
+  }
+
+  [[nodiscard]] std::shared_ptr<buffer> acquire() {
+    return std::allocate_shared<buffer>(impl::buffer_pool_allocator<buffer>(state_),
+                                        state_);
+  }
+
+private:
+  std::shared_ptr<impl::buffer_pool_state> state_;
+};
+} // namespace pqrs::process
@@ -0,0 +1,101 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+// `pqrs::process::command_spec` is immutable and can be shared between threads.
+
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace pqrs::process {
+// The arguments and the environment of a command in the form which `posix_spawn` takes.
+// Create it once and pass it to many `process` objects to avoid rebuilding them for each spawn.
+class command_spec final {
+public:
+  // The child process inherits the environment of this process at the time of `run`.
+  explicit command_spec(const std::vector<std::string>& argv)
+      : argc_(argv.size()),
+        envp_offset_(std::nullopt) {
+    build(argv, nullptr);
+  }
+
+  // `envp` is a list of "name=value".
+  command_spec(const std::vector<std::string>& argv,
+               const std::vector<std::string>& envp)
+      : argc_(argv.size()),
+        envp_offset_(argv.size() + 1) {
+    build(argv, &envp);
+  }
+
+  command_spec(const command_spec&) = delete;
+  command_spec(command_spec&&) = delete;
+  command_spec& operator=(const command_spec&) = delete;
+  command_spec& operator=(command_spec&&) = delete;
+
+  [[nodiscard]] bool empty() const noexcept {
+    return argc_ == 0;
+  }
+
+  [[nodiscard]] size_t get_argc() const noexcept {
+    return argc_;
+  }
+
+  // A null-terminated array.
+  [[nodiscard]] char* const* get_argv() const noexcept {
+    return pointers_.data();
+  }
+
+  // A null-terminated array, or nullptr if the environment is inherited.
+  [[nodiscard]] char* const* get_envp() const noexcept {
+    if (envp_offset_) {
+      return pointers_.data() + *envp_offset_;
+    }
+    return nullptr;
+  }
+
+private:
+  // All strings are stored in one arena, and the pointers to them in one array.
+  void build(const std::vector<std::string>& argv,
+             const std::vector<std::string>* envp) {
+    size_t arena_size = 0;
+    size_t pointer_count = argv.size() + 1;
+
+    for (const auto& a : argv) {
+      arena_size += a.size() + 1;
+    }
+    if (envp) {
+      for (const auto& e : *envp) {
+        arena_size += e.size() + 1;
+      }
+      pointer_count += envp->size() + 1;
+    }
+
+    arena_.resize(arena_size);
+    pointers_.reserve(pointer_count);
+
+    auto p = arena_.data();
+    auto append = [this, &p](const std::vector<std::string>& strings) {
+      for (const auto& s : strings) {
+        pointers_.push_back(p);
+        p = std::copy(std::begin(s), std::end(s), p);
+        *p++ = '\0';
+      }
+      pointers_.push_back(nullptr);
+    };
+
+    append(argv);
+    if (envp) {
+      append(*envp);
+    }
+  }
+
+  size_t argc_;
+  std::optional<size_t> envp_offset_;
+  std::vector<char> arena_;
+  std::vector<char*> pointers_;
+};
+} // namespace pqrs::process
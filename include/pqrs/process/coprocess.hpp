@@ -0,0 +1,262 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+// `pqrs::process::coprocess` can be used safely in a multi-threaded environment.
+
+#include "process.hpp"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace pqrs::process {
+enum class coprocess_framing {
+  // Each message is terminated by '\n'. The requests which contain '\n' are rejected.
+  newline,
+
+  // Each message is terminated by '\0'. The requests which contain '\0' are rejected.
+  nul,
+
+  // Each message is preceded by its length as a 4-byte big-endian integer.
+  length_prefixed,
+};
+
+// Keeps one long-lived child process and exchanges framed requests and responses over its stdin and stdout,
+// so that calling a helper many times costs a round trip instead of a spawn.
+// The child must respond to the requests in order. Multiple requests can be outstanding at the same time.
+// The stderr of the child is the stderr of this process.
+class coprocess final {
+public:
+  // Called on the dispatcher thread with the response,
+  // or with std::nullopt if the process exited before responding.
+  // The handlers which are pending when `coprocess` is destroyed are called with std::nullopt on the destroying thread.
+  using response_handler = std::function<void(std::optional<std::string> response)>;
+
+  // Signals (invoked from the dispatcher thread)
+
+  nod::signal<void()> run_failed;
+  nod::signal<void(int)> exited;
+
+  // Methods
+
+  coprocess(std::weak_ptr<dispatcher::dispatcher> weak_dispatcher,
+            const std::vector<std::string>& argv,
+            coprocess_framing framing = coprocess_framing::newline,
+            size_t max_queued_bytes = 16 * 1024 * 1024)
+      : coprocess(std::move(weak_dispatcher),
+                  std::make_shared<command_spec>(argv),
+                  framing,
+                  max_queued_bytes) {
+  }
+
+  coprocess(std::weak_ptr<dispatcher::dispatcher> weak_dispatcher,
+            std::shared_ptr<const command_spec> spec,
+            coprocess_framing framing = coprocess_framing::newline,
+            size_t max_queued_bytes = 16 * 1024 * 1024)
+      : framing_(framing),
+        process_(std::make_unique<process>(std::move(weak_dispatcher), std::move(spec))) {
+    process_->enable_stdin_pipe(max_queued_bytes);
+    process_->redirect_stderr(STDERR_FILENO);
+
+    if (framing_ == coprocess_framing::length_prefixed) {
+      process_->stdout_buffer_received.connect([this](auto&& buffer) {
+        receive_length_prefixed(buffer->get_span());
+      });
+    } else {
+      process_->enable_line_framing(framing_ == coprocess_framing::newline ? '\n' : '\0');
+      process_->stdout_line_received.connect([this](auto&& line) {
+        respond(std::string(line));
+      });
+    }
+
+    process_->run_failed.connect([this] {
+      fail_pending_requests();
+      run_failed();
+    });
+    process_->exited.connect([this](auto&& status) {
+      fail_pending_requests();
+      exited(status);
+    });
+  }
+
+  ~coprocess() {
+    // Destroy the process first since its signal handlers use the other members.
+    process_ = nullptr;
+
+    // Complete the futures instead of leaving them with std::future_error (broken_promise).
+    fail_pending_requests();
+  }
+
+  coprocess(const coprocess&) = delete;
+  coprocess(coprocess&&) = delete;
+  coprocess& operator=(const coprocess&) = delete;
+  coprocess& operator=(coprocess&&) = delete;
+
+  // Requests can be sent before `run`.
+  bool run() {
+    return process_->run();
+  }
+
+  // Send `payload` and call `handler` with the response.
+  // Returns false, without calling `handler`, if the request cannot be queued
+  // (`payload` contains the delimiter, stdin is closed, or `max_queued_bytes` are waiting to be written).
+  bool request(std::string_view payload,
+               response_handler handler) {
+    // A delimiter in the payload would split it into two requests and shift all later responses.
+    if ((framing_ == coprocess_framing::newline && payload.find('\n') != std::string_view::npos) ||
+        (framing_ == coprocess_framing::nul && payload.find('\0') != std::string_view::npos) ||
+        (framing_ == coprocess_framing::length_prefixed && payload.size() > UINT32_MAX)) {
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!process_->write_stdin(frame(payload))) {
+      return false;
+    }
+
+    pending_handlers_.push_back(std::move(handler));
+    return true;
+  }
+
+  // The future version of `request`. The value is std::nullopt if the request failed.
+  // Do not wait for the future on the dispatcher thread since the response is delivered on it.
+  [[nodiscard]] std::future<std::optional<std::string>> request(std::string_view payload) {
+    auto promise = std::make_shared<std::promise<std::optional<std::string>>>();
+    auto future = promise->get_future();
+
+    if (!request(payload,
+                 [promise](auto&& response) {
+                   promise->set_value(std::move(response));
+                 })) {
+      promise->set_value(std::nullopt);
+    }
+
+    return future;
+  }
+
+  // The number of requests waiting for their responses.
+  [[nodiscard]] size_t get_pending_request_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return pending_handlers_.size();
+  }
+
+  // Close stdin after the queued requests are written, which usually makes the child exit.
+  void close() {
+    process_->close_stdin();
+  }
+
+  void kill(int signal) {
+    process_->kill(signal);
+  }
+
+  void wait() {
+    process_->wait();
+  }
+
+  [[nodiscard]] std::optional<pid_t> get_pid() const {
+    return process_->get_pid();
+  }
+
+private:
+  std::shared_ptr<const std::vector<uint8_t>> frame(std::string_view payload) const {
+    auto data = std::make_shared<std::vector<uint8_t>>();
+    data->reserve(payload.size() + 4);
+
+    if (framing_ == coprocess_framing::length_prefixed) {
+      const auto size = static_cast<uint32_t>(payload.size());
+      for (int shift = 24; shift >= 0; shift -= 8) {
+        data->push_back(static_cast<uint8_t>(size >> shift));
+      }
+    }
+
+    data->insert(std::end(*data), std::begin(payload), std::end(payload));
+
+    if (framing_ == coprocess_framing::newline) {
+      data->push_back('\n');
+    } else if (framing_ == coprocess_framing::nul) {
+      data->push_back('\0');
+    }
+
+    return data;
+  }
+
+  //
+  // The following methods are called on the dispatcher thread.
+  //
+
+  void receive_length_prefixed(std::span<const uint8_t> data) {
+    received_.append(reinterpret_cast<const char*>(data.data()), data.size());
+
+    size_t offset = 0;
+    while (received_.size() - offset >= 4) {
+      uint32_t size = 0;
+      for (size_t i = 0; i < 4; ++i) {
+        size = (size << 8) | static_cast<uint8_t>(received_[offset + i]);
+      }
+
+      if (received_.size() - offset - 4 < size) {
+        break;
+      }
+
+      respond(received_.substr(offset + 4, size));
+      offset += 4 + size;
+    }
+
+    received_.erase(0, offset);
+  }
+
+  void respond(std::string response) {
+    response_handler handler;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      if (pending_handlers_.empty()) {
+        // An unsolicited response.
+        return;
+      }
+
+      handler = std::move(pending_handlers_.front());
+      pending_handlers_.pop_front();
+    }
+
+    if (handler) {
+      handler(std::move(response));
+    }
+  }
+
+  void fail_pending_requests() {
+    std::deque<response_handler> handlers;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      handlers.swap(pending_handlers_);
+    }
+
+    for (auto&& handler : handlers) {
+      if (handler) {
+        handler(std::nullopt);
+      }
+    }
+  }
+
+  coprocess_framing framing_;
+  std::string received_;
+  std::deque<response_handler> pending_handlers_;
+  mutable std::mutex mutex_;
+
+  std::unique_ptr<process> process_;
+};
+} // namespace pqrs::process
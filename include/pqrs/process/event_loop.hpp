@@ -0,0 +1,408 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+// `pqrs::process::event_loop::post`, `run_sync`, `stop` and `loop_thread` can be called from any thread.
+// The other methods must be called on the loop thread.
+
+#include "pipe.hpp"
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <fcntl.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <pqrs/thread_wait.hpp>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+namespace pqrs::process {
+// Multiplexes file descriptors, timers and posted functions on a single thread.
+// The backend is epoll on Linux and poll elsewhere.
+// Cross-thread wakeups use an eventfd on Linux and a self-pipe elsewhere.
+// Events are reported with the poll flags (POLLIN, POLLOUT, POLLHUP, POLLERR) on every backend.
+class event_loop final {
+public:
+  using handler = std::function<void(short revents)>;
+  using timer_id = uint64_t;
+  using clock = std::chrono::steady_clock;
+
+  event_loop() {
+#ifdef __linux__
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeup_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    if (wakeup_fd_ != -1) {
+      epoll_event e{};
+      e.events = EPOLLIN;
+      e.data.u64 = wakeup_key;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &e);
+    }
+#else
+    wakeup_pipe_ = std::make_unique<pipe>();
+
+    for (const auto& fd : {wakeup_pipe_->get_read_end(), wakeup_pipe_->get_write_end()}) {
+      if (fd) {
+        fcntl(*fd, F_SETFL, fcntl(*fd, F_GETFL) | O_NONBLOCK);
+        fcntl(*fd, F_SETFD, FD_CLOEXEC);
+      }
+    }
+#endif
+  }
+
+  ~event_loop() {
+#ifdef __linux__
+    if (wakeup_fd_ != -1) {
+      close(wakeup_fd_);
+    }
+    if (epoll_fd_ != -1) {
+      close(epoll_fd_);
+    }
+#endif
+  }
+
+  event_loop(const event_loop&) = delete;
+  event_loop(event_loop&&) = delete;
+  event_loop& operator=(const event_loop&) = delete;
+  event_loop& operator=(event_loop&&) = delete;
+
+  // Run the loop on the calling thread until `stop` is called.
+  void run() {
+    loop_thread_id_ = std::this_thread::get_id();
+
+    std::vector<std::pair<uint64_t, short>> events;
+
+    while (!stop_requested_) {
+      events.clear();
+      wait_events(events, next_timeout());
+
+      for (const auto& [key, revents] : events) {
+        if (key == wakeup_key) {
+          drain_wakeup();
+          continue;
+        }
+
+        const auto fd = static_cast<int>(key & 0xffffffff);
+        const auto generation = static_cast<uint32_t>(key >> 32);
+
+        auto it = entries_.find(fd);
+        if (it == std::end(entries_) ||
+            it->second->generation != generation) {
+          // The file descriptor was removed by a preceding handler.
+          continue;
+        }
+
+        // Keep the entry alive while the handler runs since the handler may remove itself.
+        auto e = it->second;
+        e->function(revents);
+      }
+
+      run_posted_functions();
+      run_expired_timers();
+    }
+
+    // Functions posted before `stop` are still executed.
+
+    std::vector<std::function<void()>> functions;
+    {
+      std::lock_guard<std::mutex> lock(posted_functions_mutex_);
+
+      stopped_ = true;
+      functions.swap(posted_functions_);
+    }
+
+    for (auto&& f : functions) {
+      f();
+    }
+  }
+
+  void stop() {
+    stop_requested_ = true;
+    wakeup();
+  }
+
+  void post(std::function<void()> function) {
+    {
+      std::lock_guard<std::mutex> lock(posted_functions_mutex_);
+
+      if (!stopped_) {
+        posted_functions_.push_back(std::move(function));
+        function = nullptr;
+      }
+    }
+
+    if (function) {
+      // The loop has already finished.
+      function();
+      return;
+    }
+
+    wakeup();
+  }
+
+  // Call `function` on the loop thread and wait until it returns.
+  void run_sync(std::function<void()> function) {
+    if (loop_thread()) {
+      function();
+      return;
+    }
+
+    auto wait = make_thread_wait();
+    post([&function, wait] {
+      function();
+      wait->notify();
+    });
+    wait->wait_notice();
+  }
+
+  [[nodiscard]] bool loop_thread() const {
+    return loop_thread_id_ == std::this_thread::get_id();
+  }
+
+  bool add(int fd, short events, handler function) {
+    auto e = std::make_shared<entry>();
+    e->generation = ++last_generation_;
+    e->events = events;
+    e->function = std::move(function);
+
+#ifdef __linux__
+    epoll_event ev{};
+    ev.events = to_epoll_events(events);
+    ev.data.u64 = make_key(fd, e->generation);
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+      return false;
+    }
+#endif
+
+    entries_[fd] = e;
+    return true;
+  }
+
+  void modify(int fd, short events) {
+    auto it = entries_.find(fd);
+    if (it == std::end(entries_) ||
+        it->second->events == events) {
+      return;
+    }
+
+    it->second->events = events;
+
+#ifdef __linux__
+    epoll_event ev{};
+    ev.events = to_epoll_events(events);
+    ev.data.u64 = make_key(fd, it->second->generation);
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev);
+#endif
+  }
+
+  void remove(int fd) {
+    if (entries_.erase(fd) > 0) {
+#ifdef __linux__
+      epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+    }
+  }
+
+  timer_id add_timer(clock::duration delay, std::function<void()> function) {
+    auto id = ++last_timer_id_;
+    auto when = clock::now() + delay;
+    timers_.emplace(std::make_pair(when, id), std::move(function));
+    timer_deadlines_[id] = when;
+    return id;
+  }
+
+  void cancel_timer(timer_id id) {
+    auto it = timer_deadlines_.find(id);
+    if (it != std::end(timer_deadlines_)) {
+      timers_.erase(std::make_pair(it->second, id));
+      timer_deadlines_.erase(it);
+    }
+  }
+
+private:
+  struct entry final {
+    uint32_t generation;
+    short events;
+    handler function;
+  };
+
+  static constexpr uint64_t wakeup_key = UINT64_MAX;
+
+  static uint64_t make_key(int fd, uint32_t generation) {
+    return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+  }
+
+#ifdef __linux__
+  static uint32_t to_epoll_events(short events) {
+    uint32_t result = 0;
+    if (events & POLLIN) {
+      result |= EPOLLIN;
+    }
+    if (events & POLLOUT) {
+      result |= EPOLLOUT;
+    }
+    return result;
+  }
+
+  static short to_poll_events(uint32_t events) {
+    short result = 0;
+    if (events & EPOLLIN) {
+      result |= POLLIN;
+    }
+    if (events & EPOLLOUT) {
+      result |= POLLOUT;
+    }
+    if (events & EPOLLHUP) {
+      result |= POLLHUP;
+    }
+    if (events & EPOLLERR) {
+      result |= POLLERR;
+    }
+    return result;
+  }
+#endif
+
+  int next_timeout() const {
+    if (timers_.empty()) {
+      return -1;
+    }
+
+    const auto d = std::begin(timers_)->first.first - clock::now();
+    if (d <= clock::duration::zero()) {
+      return 0;
+    }
+
+    // Round up so that the loop does not spin until the deadline.
+    return static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(d).count());
+  }
+
+  void wait_events(std::vector<std::pair<uint64_t, short>>& events, int timeout) {
+#ifdef __linux__
+    std::array<epoll_event, 64> buffer;
+    auto n = epoll_wait(epoll_fd_, buffer.data(), static_cast<int>(buffer.size()), timeout);
+    for (int i = 0; i < n; ++i) {
+      // `epoll_event` is packed on some architectures, so the fields are copied.
+      const uint64_t key = buffer[i].data.u64;
+      const uint32_t revents = buffer[i].events;
+      events.emplace_back(key, to_poll_events(revents));
+    }
+#else
+    std::vector<pollfd> poll_file_descriptors;
+    std::vector<uint64_t> keys;
+
+    if (const auto fd = wakeup_pipe_->get_read_end()) {
+      poll_file_descriptors.push_back({*fd, POLLIN, 0});
+      keys.push_back(wakeup_key);
+    }
+
+    for (const auto& [fd, e] : entries_) {
+      if (e->events != 0) {
+        poll_file_descriptors.push_back({fd, e->events, 0});
+        keys.push_back(make_key(fd, e->generation));
+      }
+    }
+
+    // EINTR is handled as a timeout; the loop simply waits again.
+    if (poll(poll_file_descriptors.data(), poll_file_descriptors.size(), timeout) > 0) {
+      for (size_t i = 0; i < poll_file_descriptors.size(); ++i) {
+        if (poll_file_descriptors[i].revents != 0) {
+          events.emplace_back(keys[i],
+                              poll_file_descriptors[i].revents);
+        }
+      }
+    }
+#endif
+  }
+
+  void wakeup() {
+#ifdef __linux__
+    uint64_t value = 1;
+    [[maybe_unused]] auto n = write(wakeup_fd_, &value, sizeof(value));
+#else
+    if (const auto fd = wakeup_pipe_->get_write_end()) {
+      uint8_t b = 0;
+      // A full pipe already guarantees a wakeup, so EAGAIN is ignored.
+      [[maybe_unused]] auto n = write(*fd, &b, sizeof(b));
+    }
+#endif
+  }
+
+  void drain_wakeup() {
+#ifdef __linux__
+    uint64_t value;
+    [[maybe_unused]] auto n = read(wakeup_fd_, &value, sizeof(value));
+#else
+    if (const auto fd = wakeup_pipe_->get_read_end()) {
+      std::array<uint8_t, 64> buffer;
+      while (read(*fd, buffer.data(), buffer.size()) > 0) {
+      }
+    }
+#endif
+  }
+
+  void run_posted_functions() {
+    std::vector<std::function<void()>> functions;
+    {
+      std::lock_guard<std::mutex> lock(posted_functions_mutex_);
+
+      functions.swap(posted_functions_);
+    }
+
+    for (auto&& f : functions) {
+      f();
+    }
+  }
+
+  void run_expired_timers() {
+    const auto now = clock::now();
+
+    while (!timers_.empty()) {
+      auto it = std::begin(timers_);
+      if (it->first.first > now) {
+        break;
+      }
+
+      auto function = std::move(it->second);
+      timer_deadlines_.erase(it->first.second);
+      timers_.erase(it);
+
+      function();
+    }
+  }
+
+#ifdef __linux__
+  int epoll_fd_ = -1;
+  int wakeup_fd_ = -1;
+#else
+  std::unique_ptr<pipe> wakeup_pipe_;
+#endif
+
+  std::unordered_map<int, std::shared_ptr<entry>> entries_;
+  uint32_t last_generation_ = 0;
+
+  std::map<std::pair<clock::time_point, timer_id>, std::function<void()>> timers_;
+  std::unordered_map<timer_id, clock::time_point> timer_deadlines_;
+  timer_id last_timer_id_ = 0;
+
+  std::vector<std::function<void()>> posted_functions_;
+  bool stopped_ = false;
+  std::mutex posted_functions_mutex_;
+
+  std::atomic<std::thread::id> loop_thread_id_;
+  std::atomic<bool> stop_requested_{false};
+};
+} // namespace pqrs::process
@@ -4,50 +4,85 @@
 // Distributed under the Boost Software License, Version 1.0.
 // (See https://www.boost.org/LICENSE_1_0.txt)
 
+#include "output_sink.hpp"
 #include "process.hpp"
-#include <sstream>
+#include <string>
+#include <utility>
 
 namespace pqrs::process {
+struct execute_options final {
+  output_sink stdout_sink = output_sink::string();
+  output_sink stderr_sink = output_sink::string();
+
+  // See `process::enable_fast_spawn`.
+  bool fast_spawn = false;
+
+  // Poll the pipes on the reactor instead of a thread per process (see `process::set_reactor`).
+  std::shared_ptr<pqrs::process::reactor> reactor;
+
+  // Terminate the process if it does not exit in time (see `process::set_deadline`).
+  // The output captured until the process exits is kept.
+  std::optional<dispatcher::duration> deadline;
+  int deadline_signal = SIGTERM;
+  dispatcher::duration deadline_grace_period = std::chrono::seconds(1);
+};
+
 // Execute the command and wait for it to finish​.
 class execute {
 public:
-  execute(const std::vector<std::string>& argv)
+  execute(const std::vector<std::string>& argv,
+          execute_options options = {})
+      : execute(std::make_shared<command_spec>(argv),
+                std::move(options)) {
+  }
+
+  execute(std::shared_ptr<const command_spec> spec,
+          execute_options options = {})
       : time_source_(std::make_shared<pqrs::dispatcher::hardware_time_source>()),
         dispatcher_(std::make_shared<dispatcher::dispatcher>(time_source_)),
-        process_(dispatcher_, argv) {
+        process_(dispatcher_, std::move(spec)),
+        stdout_sink_(std::move(options.stdout_sink)),
+        stderr_sink_(std::move(options.stderr_sink)) {
     // `process_.wait()` joins the polling thread, but the signal handlers are
     // invoked on the dispatcher thread. Use `wait` to ensure that the enqueued
-    // `stdout_received`, `stderr_received`, `run_failed`, and `exited` handlers
+    // `stdout_buffer_received`, `stderr_buffer_received`, `run_failed`, and `exited` handlers
     // have been called before capturing the results.
     const auto wait = pqrs::make_thread_wait();
 
-    std::stringstream stdout;
-    std::stringstream stderr;
-
-    process_.stdout_received.connect([&stdout](auto&& buffer) {
-      for (const auto& c : *buffer) {
-        stdout << c;
-      }
+    process_.stdout_buffer_received.connect([this](auto&& buffer) {
+      stdout_sink_.write(buffer->get_span());
     });
-    process_.stderr_received.connect([&stderr](auto&& buffer) {
-      for (const auto& c : *buffer) {
-        stderr << c;
-      }
+    process_.stderr_buffer_received.connect([this](auto&& buffer) {
+      stderr_sink_.write(buffer->get_span());
     });
     process_.run_failed.connect([wait] {
       wait->notify();
     });
+    process_.exited_with_usage.connect([this](auto&&, auto&& usage) {
+      resource_usage_ = usage;
+    });
     process_.exited.connect([this, wait](auto&& status) {
       exit_code_ = WIFEXITED(status) ? std::optional<int>(WEXITSTATUS(status)) : std::nullopt;
       wait->notify();
     });
+    if (options.fast_spawn) {
+      process_.enable_fast_spawn();
+    }
+    if (options.reactor) {
+      process_.set_reactor(options.reactor);
+    }
+    if (options.deadline) {
+      process_.set_deadline(*options.deadline,
+                            options.deadline_signal,
+                            options.deadline_grace_period);
+    }
     process_.run();
     process_.wait();
 
     wait->wait_notice();
 
-    stdout_ = stdout.str();
-    stderr_ = stderr.str();
+    stdout_ = stdout_sink_.take();
+    stderr_ = stderr_sink_.take();
   }
 
   ~execute() {
@@ -68,17 +103,48 @@ public:
     return stderr_;
   }
 
+  // Move the output out. `get_stdout` returns an empty string afterwards.
+  [[nodiscard]] std::string take_stdout() noexcept {
+    return std::exchange(stdout_, std::string());
+  }
+
+  [[nodiscard]] std::string take_stderr() noexcept {
+    return std::exchange(stderr_, std::string());
+  }
+
+  // The sizes and errors of the output.
+  [[nodiscard]] const output_sink& get_stdout_sink() const noexcept {
+    return stdout_sink_;
+  }
+
+  [[nodiscard]] const output_sink& get_stderr_sink() const noexcept {
+    return stderr_sink_;
+  }
+
   [[nodiscard]] const std::optional<int>& get_exit_code() const noexcept {
     return exit_code_;
   }
 
+  // std::nullopt if the process failed to run.
+  [[nodiscard]] const std::optional<resource_usage>& get_resource_usage() const noexcept {
+    return resource_usage_;
+  }
+
+  // Whether the process was terminated because of `execute_options::deadline`.
+  [[nodiscard]] bool get_timed_out() const {
+    return process_.get_timed_out();
+  }
+
 private:
   std::shared_ptr<dispatcher::hardware_time_source> time_source_;
   std::shared_ptr<dispatcher::dispatcher> dispatcher_;
   process process_;
 
+  output_sink stdout_sink_;
+  output_sink stderr_sink_;
   std::string stdout_;
   std::string stderr_;
   std::optional<int> exit_code_;
+  std::optional<resource_usage> resource_usage_;
 };
 } // namespace pqrs::process
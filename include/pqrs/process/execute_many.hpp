@@ -0,0 +1,182 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+#include "execute_result.hpp"
+#include "process.hpp"
+#include "reactor.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace pqrs::process {
+struct execute_many_options final {
+  // The maximum number of processes running at the same time.
+  // 0 means the number of hardware threads.
+  size_t concurrency = 0;
+
+  // The number of threads which poll the pipes.
+  size_t loop_count = 1;
+
+  // See `process::enable_fast_spawn`.
+  bool fast_spawn = false;
+};
+
+// Execute the commands in parallel and wait for all of them to finish.
+// All processes share one dispatcher and one reactor.
+class execute_many final {
+public:
+  // Called on the thread which constructs `execute_many`, in the order of completion.
+  using completion_handler = std::function<void(size_t index, execute_result&& result)>;
+
+  // Keep the results in the order of `commands`.
+  execute_many(const std::vector<std::vector<std::string>>& commands,
+               execute_many_options options = {})
+      : execute_many(options) {
+    results_.resize(commands.size());
+
+    run(commands, [this](auto&& index, auto&& result) {
+      results_[index] = std::move(result);
+    });
+  }
+
+  // Pass each result to `handler` as soon as the command finishes. The results are not kept.
+  execute_many(const std::vector<std::vector<std::string>>& commands,
+               completion_handler handler,
+               execute_many_options options = {})
+      : execute_many(options) {
+    run(commands, handler);
+  }
+
+  ~execute_many() {
+    dispatcher_->terminate();
+    dispatcher_ = nullptr;
+  }
+
+  execute_many(const execute_many&) = delete;
+  execute_many(execute_many&&) = delete;
+  execute_many& operator=(const execute_many&) = delete;
+  execute_many& operator=(execute_many&&) = delete;
+
+  [[nodiscard]] const std::vector<execute_result>& get_results() const noexcept {
+    return results_;
+  }
+
+  [[nodiscard]] std::vector<execute_result> take_results() noexcept {
+    return std::exchange(results_, std::vector<execute_result>());
+  }
+
+private:
+  explicit execute_many(const execute_many_options& options)
+      : time_source_(std::make_shared<pqrs::dispatcher::hardware_time_source>()),
+        dispatcher_(std::make_shared<dispatcher::dispatcher>(time_source_)),
+        reactor_(std::make_shared<reactor>(std::max(options.loop_count, size_t(1)))),
+        concurrency_(options.concurrency > 0
+                         ? options.concurrency
+                         : std::max(std::thread::hardware_concurrency(), 1u)),
+        fast_spawn_(options.fast_spawn) {
+  }
+
+  struct job final {
+    std::unique_ptr<pqrs::process::process> p;
+    execute_result result;
+  };
+
+  void run(const std::vector<std::vector<std::string>>& commands,
+           const completion_handler& handler) {
+    // The signal handlers are invoked on the dispatcher thread.
+    // They report the completion to this thread, which starts the next command and destroys the finished process.
+    std::deque<size_t> completed;
+    std::mutex completed_mutex;
+    std::condition_variable completed_cv;
+
+    auto complete = [&](size_t index) {
+      {
+        std::lock_guard<std::mutex> lock(completed_mutex);
+
+        completed.push_back(index);
+      }
+      completed_cv.notify_one();
+    };
+
+    std::unordered_map<size_t, std::unique_ptr<job>> running;
+    size_t next = 0;
+
+    while (next < commands.size() || !running.empty()) {
+      while (next < commands.size() && running.size() < concurrency_) {
+        const auto index = next++;
+
+        auto j = std::make_unique<job>();
+        j->p = std::make_unique<process>(dispatcher_, commands[index]);
+        j->p->set_reactor(reactor_);
+        if (fast_spawn_) {
+          j->p->enable_fast_spawn();
+        }
+
+        auto& r = j->result;
+        j->p->stdout_buffer_received.connect([&r](auto&& buffer) {
+          r.stdout_.append(std::begin(*buffer), std::end(*buffer));
+        });
+        j->p->stderr_buffer_received.connect([&r](auto&& buffer) {
+          r.stderr_.append(std::begin(*buffer), std::end(*buffer));
+        });
+        j->p->run_failed.connect([&r, &complete, index] {
+          r.run_failed_ = true;
+          complete(index);
+        });
+        j->p->exited_with_usage.connect([&r](auto&&, auto&& usage) {
+          r.resource_usage_ = usage;
+        });
+        j->p->exited.connect([&r, &complete, index](auto&& status) {
+          r.exit_code_ = WIFEXITED(status) ? std::optional<int>(WEXITSTATUS(status)) : std::nullopt;
+          complete(index);
+        });
+
+        auto& p = *(j->p);
+        running.emplace(index, std::move(j));
+        p.run();
+      }
+
+      size_t index;
+      {
+        std::unique_lock<std::mutex> lock(completed_mutex);
+
+        completed_cv.wait(lock, [&completed] {
+          return !completed.empty();
+        });
+
+        index = completed.front();
+        completed.pop_front();
+      }
+
+      auto it = running.find(index);
+      auto j = std::move(it->second);
+      running.erase(it);
+
+      // Release the pipes before starting the next command.
+      j->p = nullptr;
+
+      handler(index, std::move(j->result));
+    }
+  }
+
+  std::shared_ptr<dispatcher::hardware_time_source> time_source_;
+  std::shared_ptr<dispatcher::dispatcher> dispatcher_;
+  std::shared_ptr<reactor> reactor_;
+  size_t concurrency_;
+  bool fast_spawn_;
+
+  std::vector<execute_result> results_;
+};
+} // namespace pqrs::process
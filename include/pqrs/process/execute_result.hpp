@@ -0,0 +1,62 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+#include "resource_usage.hpp"
+#include <optional>
+#include <string>
+#include <utility>
+
+namespace pqrs::process {
+// The result of a command run by `execute_many` or `async_execute`.
+class execute_result final {
+public:
+  [[nodiscard]] const std::string& get_stdout() const noexcept {
+    return stdout_;
+  }
+
+  [[nodiscard]] const std::string& get_stderr() const noexcept {
+    return stderr_;
+  }
+
+  [[nodiscard]] std::string take_stdout() noexcept {
+    return std::exchange(stdout_, std::string());
+  }
+
+  [[nodiscard]] std::string take_stderr() noexcept {
+    return std::exchange(stderr_, std::string());
+  }
+
+  // std::nullopt if the process failed to run or was terminated by a signal.
+  [[nodiscard]] const std::optional<int>& get_exit_code() const noexcept {
+    return exit_code_;
+  }
+
+  [[nodiscard]] bool get_run_failed() const noexcept {
+    return run_failed_;
+  }
+
+  // std::nullopt if the process failed to run.
+  [[nodiscard]] const std::optional<resource_usage>& get_resource_usage() const noexcept {
+    return resource_usage_;
+  }
+
+  // Whether the process was terminated because of `execute_options::deadline`.
+  [[nodiscard]] bool get_timed_out() const noexcept {
+    return timed_out_;
+  }
+
+private:
+  friend class async_execute;
+  friend class execute_many;
+
+  std::string stdout_;
+  std::string stderr_;
+  std::optional<int> exit_code_;
+  std::optional<resource_usage> resource_usage_;
+  bool run_failed_ = false;
+  bool timed_out_ = false;
+};
+} // namespace pqrs::process
@@ -0,0 +1,13 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+#include <functional>
+
+namespace pqrs::process {
+// Runs `function` on a thread chosen by the caller, e.g. by posting it to a thread pool.
+// `async_execute` and `process_reader` resume the awaiting coroutine through it.
+using executor = std::function<void(std::function<void()> function)>;
+} // namespace pqrs::process
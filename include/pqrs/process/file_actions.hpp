@@ -4,6 +4,7 @@
 // Distributed under the Boost Software License, Version 1.0.
 // (See https://www.boost.org/LICENSE_1_0.txt)
 
+#include <cerrno>
 #include <spawn.h>
 
 namespace pqrs::process {
@@ -45,10 +46,25 @@ public:
                                             newfiledes);
   }
 
+  // Close all file descriptors greater than or equal to `from` in the child process.
+  // glibc 2.34 or later implements this with close_range, which does not depend on the number of open descriptors.
+  // Returns ENOSYS where it is not available.
+  int addclosefrom(int from) noexcept {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34))
+    return posix_spawn_file_actions_addclosefrom_np(&actions_,
+                                                    from);
+#else
+    (void)from;
+    return ENOSYS;
+#endif
+  }
+
+#ifdef __APPLE__
   int addinherit_np(int file_descriptor) noexcept {
     return posix_spawn_file_actions_addinherit_np(&actions_,
                                                   file_descriptor);
   }
+#endif
 
 private:
   posix_spawn_file_actions_t actions_;
@@ -0,0 +1,132 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+// `pqrs::process::frame_assembler` is not thread-safe.
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace pqrs::process {
+enum class frame_delimiter_type {
+  // Frames are separated by the delimiter (e.g., "\n\n" for blank lines).
+  // The delimiter is not included in the frames, and empty frames are skipped.
+  separator,
+
+  // Each frame begins with a line which starts with the delimiter (e.g., "Processes:" for `top -l`).
+  // The header line is included in the frame, and the output before the first header is discarded.
+  header,
+};
+
+// Splits a byte stream into frames, keeping only the latest complete frame.
+// Only the partial frame is buffered.
+class frame_assembler final {
+public:
+  frame_assembler(std::string delimiter,
+                  frame_delimiter_type type)
+      : delimiter_(std::move(delimiter)),
+        type_(type) {
+    if (delimiter_.empty()) {
+      delimiter_ = "\n";
+    }
+  }
+
+  // Returns the latest frame completed by `data`, or std::nullopt.
+  // The older frames completed by `data` are counted in `get_dropped_count`.
+  std::optional<std::string> append(std::string_view data) {
+    pending_.append(data);
+
+    std::optional<std::string> latest;
+    const auto complete = [this, &latest](std::string frame) {
+      if (latest) {
+        ++dropped_count_;
+      }
+      latest = std::move(frame);
+    };
+
+    if (type_ == frame_delimiter_type::separator) {
+      size_t start = 0;
+      for (auto pos = pending_.find(delimiter_, scan_);
+           pos != std::string::npos;
+           pos = pending_.find(delimiter_, start)) {
+        if (pos > start) {
+          complete(pending_.substr(start, pos - start));
+        }
+        start = pos + delimiter_.size();
+      }
+      pending_.erase(0, start);
+      scan_ = first_unverified_position();
+
+    } else {
+      for (auto pos = find_header(scan_);
+           pos != std::string::npos;
+           pos = find_header(1)) {
+        if (header_found_ && pos > 0) {
+          complete(pending_.substr(0, pos));
+        }
+        pending_.erase(0, pos);
+        header_found_ = true;
+        scan_ = 1;
+      }
+      scan_ = std::max(scan_, first_unverified_position());
+
+      if (!header_found_ && scan_ > 1) {
+        // Keep the last checked character to see whether the next header starts a line.
+        pending_.erase(0, scan_ - 1);
+        scan_ = 1;
+      }
+    }
+
+    return latest;
+  }
+
+  // Returns the last frame which is not terminated at the end of the stream, or std::nullopt.
+  std::optional<std::string> flush() {
+    std::optional<std::string> frame;
+    if (!pending_.empty() &&
+        (type_ == frame_delimiter_type::separator || header_found_)) {
+      frame = std::move(pending_);
+    }
+
+    pending_.clear();
+    scan_ = 0;
+    return frame;
+  }
+
+  // The number of frames which were superseded by a newer frame in the same `append`.
+  [[nodiscard]] uint64_t get_dropped_count() const noexcept {
+    return dropped_count_;
+  }
+
+private:
+  size_t find_header(size_t from) const {
+    for (auto pos = pending_.find(delimiter_, from);
+         pos != std::string::npos;
+         pos = pending_.find(delimiter_, pos + 1)) {
+      if (pos == 0 || pending_[pos - 1] == '\n') {
+        return pos;
+      }
+    }
+    return std::string::npos;
+  }
+
+  // The delimiter cannot be matched at the later positions until more data arrives.
+  size_t first_unverified_position() const {
+    return pending_.size() + 1 >= delimiter_.size() ? pending_.size() + 1 - delimiter_.size() : 0;
+  }
+
+  std::string delimiter_;
+  frame_delimiter_type type_;
+  std::string pending_;
+  // The delimiter does not start before this position in `pending_`.
+  size_t scan_ = 0;
+  bool header_found_ = false;
+  uint64_t dropped_count_ = 0;
+};
+} // namespace pqrs::process
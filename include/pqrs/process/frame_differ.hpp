@@ -0,0 +1,215 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+// `pqrs::process::frame_differ` is not thread-safe.
+// `pqrs::process::frame_delta` can be read from multiple threads.
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace pqrs::process {
+// The lines which differ from the previous frame.
+struct frame_delta final {
+  enum class operation {
+    changed,
+    added,
+    removed,
+  };
+
+  struct change final {
+    operation op;
+    // The index of the line in the frame (in the previous frame for `removed`).
+    size_t index;
+    // Refers to `frame`. Empty for `removed`.
+    std::string_view line;
+  };
+
+  // The whole frame, which keeps `line` valid.
+  std::shared_ptr<const std::string> frame;
+  // The number of lines in `frame`.
+  size_t line_count = 0;
+  // Grouped by the ranges of unmatched lines from the top of the frame.
+  // Within each range, the `changed` and `added` entries (indices in `frame`) come first in ascending order,
+  // followed by the `removed` entries (indices in the previous frame) in ascending order.
+  // So the indices in each index space ascend through the list, but `removed` entries are not ordered against the others.
+  // All lines are `added` for the first frame.
+  std::vector<change> changes;
+};
+
+// Compares each frame line by line with the previous one.
+// Lines are matched by their hashes, so a line inserted into or removed from the middle of a frame
+// (e.g., a process which appears in `top -l 0`) is reported as a single `added` or `removed` line.
+// The common leading and trailing lines are skipped first, and the rest is aligned on the lines
+// which appear exactly once in both frames (patience diff), so the cost beyond hashing grows with the changed range.
+// The unmatched lines between the aligned ones are reported as `changed` in pairs, then as `added` or `removed`.
+// Only the hashes of the previous lines are kept, so two different lines with the same hash are treated as unchanged.
+class frame_differ final {
+public:
+  [[nodiscard]] frame_delta diff(std::shared_ptr<const std::string> frame) {
+    frame_delta delta;
+    delta.frame = std::move(frame);
+
+    lines_.clear();
+    hashes_.clear();
+
+    const std::string_view text(*delta.frame);
+    size_t begin = 0;
+    while (begin < text.size()) {
+      auto end = text.find('\n', begin);
+      if (end == std::string_view::npos) {
+        end = text.size();
+      }
+
+      const auto line = text.substr(begin, end - begin);
+      lines_.push_back(line);
+      hashes_.push_back(std::hash<std::string_view>{}(line));
+
+      begin = end + 1;
+    }
+
+    diff_range(delta, 0, previous_hashes_.size(), 0, hashes_.size());
+
+    previous_hashes_.swap(hashes_);
+    lines_.clear();
+
+    delta.line_count = previous_hashes_.size();
+    return delta;
+  }
+
+private:
+  // Compare previous_hashes_[old_begin, old_end) with hashes_[new_begin, new_end).
+  void diff_range(frame_delta& delta,
+                  size_t old_begin,
+                  size_t old_end,
+                  size_t new_begin,
+                  size_t new_end) const {
+    while (old_begin < old_end &&
+           new_begin < new_end &&
+           previous_hashes_[old_begin] == hashes_[new_begin]) {
+      ++old_begin;
+      ++new_begin;
+    }
+    while (old_begin < old_end &&
+           new_begin < new_end &&
+           previous_hashes_[old_end - 1] == hashes_[new_end - 1]) {
+      --old_end;
+      --new_end;
+    }
+
+    if (old_begin == old_end || new_begin == new_end) {
+      add_unmatched(delta, old_begin, old_end, new_begin, new_end);
+      return;
+    }
+
+    // Align on the lines which appear exactly once in both ranges.
+
+    struct occurrence final {
+      size_t old_count = 0;
+      size_t new_count = 0;
+      size_t old_index = 0;
+      size_t new_index = 0;
+    };
+    std::unordered_map<uint64_t, occurrence> occurrences;
+    for (auto i = old_begin; i < old_end; ++i) {
+      auto& o = occurrences[previous_hashes_[i]];
+      ++o.old_count;
+      o.old_index = i;
+    }
+    for (auto i = new_begin; i < new_end; ++i) {
+      auto it = occurrences.find(hashes_[i]);
+      if (it != std::end(occurrences)) {
+        ++it->second.new_count;
+        it->second.new_index = i;
+      }
+    }
+
+    // The old indices of the unique lines in the order of the new index.
+    std::vector<std::pair<size_t, size_t>> candidates;
+    for (auto i = new_begin; i < new_end; ++i) {
+      auto it = occurrences.find(hashes_[i]);
+      if (it != std::end(occurrences) &&
+          it->second.old_count == 1 &&
+          it->second.new_count == 1) {
+        candidates.emplace_back(it->second.old_index, i);
+      }
+    }
+
+    const auto anchors = longest_increasing_subsequence(candidates);
+    if (anchors.empty()) {
+      add_unmatched(delta, old_begin, old_end, new_begin, new_end);
+      return;
+    }
+
+    for (const auto& [old_index, new_index] : anchors) {
+      diff_range(delta, old_begin, old_index, new_begin, new_index);
+      old_begin = old_index + 1;
+      new_begin = new_index + 1;
+    }
+    diff_range(delta, old_begin, old_end, new_begin, new_end);
+  }
+
+  void add_unmatched(frame_delta& delta,
+                     size_t old_begin,
+                     size_t old_end,
+                     size_t new_begin,
+                     size_t new_end) const {
+    while (old_begin < old_end && new_begin < new_end) {
+      delta.changes.push_back({frame_delta::operation::changed, new_begin, lines_[new_begin]});
+      ++old_begin;
+      ++new_begin;
+    }
+    for (; new_begin < new_end; ++new_begin) {
+      delta.changes.push_back({frame_delta::operation::added, new_begin, lines_[new_begin]});
+    }
+    for (; old_begin < old_end; ++old_begin) {
+      delta.changes.push_back({frame_delta::operation::removed, old_begin, std::string_view()});
+    }
+  }
+
+  // `candidates` is sorted by `second`. Returns the longest subsequence which is also increasing in `first`.
+  static std::vector<std::pair<size_t, size_t>> longest_increasing_subsequence(const std::vector<std::pair<size_t, size_t>>& candidates) {
+    // tails[k] is the index in `candidates` of the smallest tail of the increasing subsequences of length k + 1.
+    std::vector<size_t> tails;
+    std::vector<size_t> predecessors(candidates.size());
+
+    for (size_t i = 0; i < candidates.size(); ++i) {
+      auto it = std::lower_bound(std::begin(tails),
+                                 std::end(tails),
+                                 candidates[i].first,
+                                 [&candidates](auto&& t, auto&& value) {
+                                   return candidates[t].first < value;
+                                 });
+      predecessors[i] = (it == std::begin(tails)) ? i : *(it - 1);
+      if (it == std::end(tails)) {
+        tails.push_back(i);
+      } else {
+        *it = i;
+      }
+    }
+
+    std::vector<std::pair<size_t, size_t>> result(tails.size());
+    if (!tails.empty()) {
+      auto i = tails.back();
+      for (auto k = tails.size(); k > 0; --k) {
+        result[k - 1] = candidates[i];
+        i = predecessors[i];
+      }
+    }
+    return result;
+  }
+
+  std::vector<uint64_t> previous_hashes_;
+  // The lines and hashes of the frame being compared. They are kept as members to reuse the memory.
+  std::vector<std::string_view> lines_;
+  std::vector<uint64_t> hashes_;
+};
+} // namespace pqrs::process
@@ -0,0 +1,120 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+// `pqrs::process::line_framer` is not thread-safe.
+// `pqrs::process::line_batch` can be read from multiple threads.
+
+#include "buffer_pool.hpp"
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace pqrs::process {
+// Complete lines found in a chunk.
+// Lines which are entirely inside the chunk refer to the chunk without copying.
+class line_batch final {
+  friend class line_framer;
+
+public:
+  [[nodiscard]] size_t size() const noexcept {
+    return (head_ ? 1 : 0) + ranges_.size();
+  }
+
+  // Call `function(std::string_view)` for each line in order.
+  template <typename F>
+  void for_each(F&& function) const {
+    if (head_) {
+      function(std::string_view(*head_));
+    }
+
+    if (chunk_) {
+      const auto data = reinterpret_cast<const char*>(chunk_->data());
+      for (const auto& [offset, length] : ranges_) {
+        function(std::string_view(data + offset, length));
+      }
+    }
+  }
+
+private:
+  // The line which started in the previous chunks.
+  std::optional<std::string> head_;
+  std::shared_ptr<const buffer> chunk_;
+  std::vector<std::pair<size_t, size_t>> ranges_;
+};
+
+// Splits a byte stream into lines, carrying a partial line over to the next chunk.
+// Lines do not include the delimiter.
+class line_framer final {
+public:
+  explicit line_framer(char delimiter = '\n')
+      : delimiter_(delimiter) {
+  }
+
+  // Returns nullptr if the chunk does not complete any line.
+  std::shared_ptr<const line_batch> append(std::shared_ptr<const buffer> chunk) {
+    const auto begin = reinterpret_cast<const char*>(chunk->data());
+    const auto end = begin + chunk->size();
+
+    auto p = find_delimiter(begin, end);
+    if (p == end) {
+      pending_.append(begin, end);
+      return nullptr;
+    }
+
+    auto batch = std::make_shared<line_batch>();
+
+    if (!pending_.empty()) {
+      pending_.append(begin, p);
+      batch->head_ = std::move(pending_);
+      pending_.clear();
+    } else {
+      batch->ranges_.emplace_back(0, p - begin);
+    }
+
+    while (true) {
+      auto line_begin = p + 1;
+      p = find_delimiter(line_begin, end);
+      if (p == end) {
+        pending_.append(line_begin, end);
+        break;
+      }
+      batch->ranges_.emplace_back(line_begin - begin, p - line_begin);
+    }
+
+    batch->chunk_ = std::move(chunk);
+    return batch;
+  }
+
+  // Returns the last line which is not terminated by the delimiter, or nullptr.
+  std::shared_ptr<const line_batch> flush() {
+    if (pending_.empty()) {
+      return nullptr;
+    }
+
+    auto batch = std::make_shared<line_batch>();
+    batch->head_ = std::move(pending_);
+    pending_.clear();
+    return batch;
+  }
+
+private:
+  // `memchr` is vectorized (SSE2/AVX2 on x86_64, NEON on arm64) by both glibc and libSystem,
+  // and is faster than a hand-written SIMD loop for the line lengths we see.
+  const char* find_delimiter(const char* begin, const char* end) const {
+    if (auto p = std::memchr(begin, delimiter_, end - begin)) {
+      return static_cast<const char*>(p);
+    }
+    return end;
+  }
+
+  char delimiter_;
+  std::string pending_;
+};
+} // namespace pqrs::process
@@ -0,0 +1,162 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+// `pqrs::process::output_sink` is not thread-safe.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <unistd.h>
+
+namespace pqrs::process {
+// Where `execute` stores the output of the process.
+class output_sink final {
+public:
+  enum class type {
+    string,
+    discard,
+    file_descriptor,
+    head_and_tail,
+  };
+
+  // Append everything to a string. `capacity_hint` is reserved up front.
+  static output_sink string(size_t capacity_hint = 0) {
+    output_sink s(type::string);
+    s.head_.reserve(capacity_hint);
+    return s;
+  }
+
+  // Only the size is recorded.
+  static output_sink discard() {
+    return output_sink(type::discard);
+  }
+
+  // Write to a file descriptor owned by the caller.
+  static output_sink file_descriptor(int fd) {
+    output_sink s(type::file_descriptor);
+    s.file_descriptor_ = fd;
+    return s;
+  }
+
+  // Keep the first `head_size` bytes and the last `tail_size` bytes.
+  static output_sink head_and_tail(size_t head_size, size_t tail_size) {
+    output_sink s(type::head_and_tail);
+    s.head_size_ = head_size;
+    s.tail_size_ = tail_size;
+    return s;
+  }
+
+  [[nodiscard]] type get_type() const noexcept {
+    return type_;
+  }
+
+  // The number of bytes written to this sink.
+  [[nodiscard]] size_t get_total_size() const noexcept {
+    return total_size_;
+  }
+
+  // The number of bytes dropped between the head and the tail (`head_and_tail` only).
+  [[nodiscard]] size_t get_omitted_size() const noexcept {
+    if (type_ != type::head_and_tail ||
+        total_size_ <= head_size_ + tail_size_) {
+      return 0;
+    }
+    return total_size_ - head_size_ - tail_size_;
+  }
+
+  // The last `write` error (`file_descriptor` only). Nothing is written after an error.
+  [[nodiscard]] int get_error() const noexcept {
+    return error_;
+  }
+
+  void write(std::span<const uint8_t> data) {
+    total_size_ += data.size();
+
+    const auto begin = reinterpret_cast<const char*>(data.data());
+    const auto end = begin + data.size();
+
+    switch (type_) {
+      case type::string:
+        head_.append(begin, end);
+        break;
+
+      case type::discard:
+        break;
+
+      case type::file_descriptor:
+        write_to_file_descriptor(begin, end);
+        break;
+
+      case type::head_and_tail: {
+        auto p = begin;
+        if (head_.size() < head_size_) {
+          p += std::min(head_size_ - head_.size(), data.size());
+          head_.append(begin, p);
+        }
+
+        if (p != end && tail_size_ > 0) {
+          // Trim lazily so that appending stays amortized O(1).
+          tail_.append(p, end);
+          if (tail_.size() >= tail_size_ * 2) {
+            tail_.erase(0, tail_.size() - tail_size_);
+          }
+        }
+        break;
+      }
+    }
+  }
+
+  // Move the stored bytes out (`string` and `head_and_tail`).
+  // For `head_and_tail`, the head and the tail are concatenated.
+  [[nodiscard]] std::string take() {
+    if (type_ == type::head_and_tail && !tail_.empty()) {
+      if (tail_.size() > tail_size_) {
+        tail_.erase(0, tail_.size() - tail_size_);
+      }
+      head_ += tail_;
+      tail_.clear();
+    }
+
+    return std::move(head_);
+  }
+
+private:
+  explicit output_sink(type t)
+      : type_(t) {
+  }
+
+  void write_to_file_descriptor(const char* begin, const char* end) {
+    while (error_ == 0 && begin != end) {
+      const auto n = ::write(file_descriptor_, begin, end - begin);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        error_ = errno;
+        break;
+      }
+      begin += n;
+    }
+  }
+
+  type type_;
+  size_t total_size_ = 0;
+
+  // `string`, and the head of `head_and_tail`.
+  std::string head_;
+
+  // `head_and_tail`
+  std::string tail_;
+  size_t head_size_ = 0;
+  size_t tail_size_ = 0;
+
+  // `file_descriptor`
+  int file_descriptor_ = -1;
+  int error_ = 0;
+};
+} // namespace pqrs::process
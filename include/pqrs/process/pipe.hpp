@@ -5,17 +5,33 @@
 // (See https://www.boost.org/LICENSE_1_0.txt)
 
 #include <array>
+#include <fcntl.h>
 #include <mutex>
 #include <optional>
 #include <unistd.h>
 
 namespace pqrs::process {
+// Both ends are close-on-exec, so that they are not inherited by the processes which are spawned concurrently by other threads.
+// `adddup2` in `file_actions` clears FD_CLOEXEC on the duplicated descriptor.
 class pipe final {
 public:
   pipe() {
+#ifdef __APPLE__
+    // macOS does not have pipe2. The descriptors can leak into a process spawned between `pipe` and `fcntl`
+    // unless it is spawned with POSIX_SPAWN_CLOEXEC_DEFAULT (see `process::enable_close_other_file_descriptors`).
     if (::pipe(file_descriptors_.data()) != 0) {
       file_descriptors_.fill(-1);
+      return;
     }
+
+    for (const auto fd : file_descriptors_) {
+      fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+    }
+#else
+    if (::pipe2(file_descriptors_.data(), O_CLOEXEC) != 0) {
+      file_descriptors_.fill(-1);
+    }
+#endif
   }
 
   ~pipe() {
@@ -48,6 +64,44 @@ public:
     return std::nullopt;
   }
 
+  // The parent's end is handled by an event loop, which must never block in `read` or `write`.
+  void set_read_end_nonblocking() {
+    set_nonblocking(0);
+  }
+
+  void set_write_end_nonblocking() {
+    set_nonblocking(1);
+  }
+
+  // Returns false if the capacity cannot be changed (e.g., F_SETPIPE_SZ is not available).
+  bool set_capacity(size_t bytes) {
+#ifdef F_SETPIPE_SZ
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (const auto fd = file_descriptors_[0];
+        fd != -1) {
+      return fcntl(fd, F_SETPIPE_SZ, static_cast<int>(bytes)) != -1;
+    }
+#endif
+    return false;
+  }
+
+  // Returns std::nullopt if the capacity is unknown.
+  [[nodiscard]] std::optional<size_t> get_capacity() const {
+#ifdef F_GETPIPE_SZ
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (const auto fd = file_descriptors_[0];
+        fd != -1) {
+      if (const auto result = fcntl(fd, F_GETPIPE_SZ);
+          result != -1) {
+        return result;
+      }
+    }
+#endif
+    return std::nullopt;
+  }
+
   void close_read_end() {
     std::lock_guard<std::mutex> lock(mutex_);
 
@@ -67,6 +121,15 @@ public:
   }
 
 private:
+  void set_nonblocking(size_t index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (const auto fd = file_descriptors_[index];
+        fd != -1) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+  }
+
   std::array<int, 2> file_descriptors_{
       -1,
       -1,
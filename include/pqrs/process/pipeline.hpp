@@ -0,0 +1,237 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+// `pqrs::process::pipeline` can be used safely in a multi-threaded environment.
+
+#include "pipe.hpp"
+#include "process.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <nod/nod.hpp>
+#include <pqrs/dispatcher.hpp>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace pqrs::process {
+// Run commands connected with pipes like `cmd1 | cmd2 | cmd3` without a shell.
+// The stdout of each stage is connected to the stdin of the next stage directly,
+// so the data between stages does not pass through this process.
+class pipeline final : public dispatcher::extra::dispatcher_client {
+public:
+  // Signals (invoked from the dispatcher thread)
+
+  // The output of the last stage.
+  nod::signal<void(std::shared_ptr<std::vector<uint8_t>>)> stdout_received;
+  nod::signal<void(std::shared_ptr<std::vector<uint8_t>>)> stderr_received;
+  nod::signal<void(std::shared_ptr<const buffer>)> stdout_buffer_received;
+  nod::signal<void(std::shared_ptr<const buffer>)> stderr_buffer_received;
+
+  // The stderr of each stage, including the last stage (requires `enable_stage_stderr`).
+  nod::signal<void(size_t, std::shared_ptr<const buffer>)> stage_stderr_received;
+
+  // The stage index and the status.
+  nod::signal<void(size_t, int)> stage_exited;
+
+  // `exited` is not emitted if `run_failed` is emitted.
+  nod::signal<void()> run_failed;
+
+  // All stages have exited. The argument is the status of the last stage.
+  nod::signal<void(int)> exited;
+
+  // Methods
+
+  pipeline(std::weak_ptr<dispatcher::dispatcher> weak_dispatcher,
+           const std::vector<std::vector<std::string>>& stages)
+      : dispatcher_client(weak_dispatcher),
+        weak_dispatcher_(weak_dispatcher),
+        stages_(stages) {
+  }
+
+  ~pipeline() {
+    // The slots connected to the stages refer to `this`.
+    // Destroy the stages first so that no slot is called after this point.
+    std::vector<std::unique_ptr<process>> processes;
+    {
+      std::lock_guard<std::mutex> lock(processes_mutex_);
+
+      processes = std::move(processes_);
+    }
+    processes.clear();
+
+    detach_from_dispatcher();
+  }
+
+  pipeline(const pipeline&) = delete;
+  pipeline(pipeline&&) = delete;
+  pipeline& operator=(const pipeline&) = delete;
+  pipeline& operator=(pipeline&&) = delete;
+
+  // This must be called before `run`.
+  void set_reactor(std::shared_ptr<reactor> value) {
+    reactor_ = value;
+  }
+
+  // Deliver the stderr of every stage through `stage_stderr_received`.
+  // Otherwise, the stages except the last one inherit the parent's stderr.
+  // This must be called before `run`.
+  void enable_stage_stderr() {
+    stage_stderr_ = true;
+  }
+
+  void run() {
+    // `pipeline` is a one-shot object.
+    if (run_started_.exchange(true) ||
+        stages_.empty()) {
+      enqueue_to_dispatcher([this] {
+        run_failed();
+      });
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(processes_mutex_);
+
+    // The read end of the pipe from the previous stage.
+    std::unique_ptr<pipe> previous_pipe;
+
+    for (size_t i = 0; i < stages_.size(); ++i) {
+      const auto last = (i == stages_.size() - 1);
+
+      // Create the process just before spawning it, so that its pipes do not leak into the previous stages.
+      auto p = std::make_unique<process>(weak_dispatcher_, stages_[i]);
+
+      if (reactor_) {
+        p->set_reactor(reactor_);
+      }
+
+      if (previous_pipe) {
+        if (const auto fd = previous_pipe->get_read_end()) {
+          p->redirect_stdin(*fd);
+        }
+      }
+
+      std::unique_ptr<pipe> next_pipe;
+      if (!last) {
+        // The pipe is close-on-exec, so it is not inherited by the other stages.
+        // Otherwise, a stage would not receive EOF or SIGPIPE when its neighbor exits.
+        next_pipe = std::make_unique<pipe>();
+
+        if (const auto fd = next_pipe->get_write_end()) {
+          p->redirect_stdout(*fd);
+        }
+
+        if (!stage_stderr_) {
+          p->redirect_stderr(STDERR_FILENO);
+        }
+      } else {
+        p->stdout_buffer_received.connect([this](auto&& buffer) {
+          emit(stdout_buffer_received, stdout_received, buffer);
+        });
+        p->stderr_buffer_received.connect([this](auto&& buffer) {
+          emit(stderr_buffer_received, stderr_received, buffer);
+        });
+      }
+
+      if (stage_stderr_) {
+        p->stderr_buffer_received.connect([this, i](auto&& buffer) {
+          stage_stderr_received(i, buffer);
+        });
+      }
+
+      p->exited.connect([this, i](auto&& status) {
+        handle_stage_exited(i, status);
+      });
+
+      const auto started = p->run();
+
+      processes_.push_back(std::move(p));
+
+      if (!started) {
+        // The started stages may wait for input forever.
+        for (const auto& q : processes_) {
+          q->kill(SIGKILL);
+        }
+
+        enqueue_to_dispatcher([this] {
+          run_failed();
+        });
+        return;
+      }
+
+      // The pipe ends which are passed to the child processes are no longer needed.
+      previous_pipe = std::move(next_pipe);
+      if (previous_pipe) {
+        previous_pipe->close_write_end();
+      }
+    }
+  }
+
+  void kill(int signal) {
+    std::lock_guard<std::mutex> lock(processes_mutex_);
+
+    for (const auto& p : processes_) {
+      p->kill(signal);
+    }
+  }
+
+  // Wait until all stages are finished.
+  // `exited` has already been enqueued to the dispatcher when `wait` returns.
+  void wait() {
+    std::vector<process*> processes;
+    {
+      std::lock_guard<std::mutex> lock(processes_mutex_);
+
+      for (const auto& p : processes_) {
+        processes.push_back(p.get());
+      }
+    }
+
+    for (const auto& p : processes) {
+      p->wait();
+    }
+  }
+
+private:
+  // This method is called on the dispatcher thread.
+  void handle_stage_exited(size_t index, int status) {
+    stage_exited(index, status);
+
+    if (index == stages_.size() - 1) {
+      last_status_ = status;
+    }
+
+    if (++exited_count_ == stages_.size()) {
+      exited(last_status_);
+    }
+  }
+
+  // The vector is created only if a slot is connected.
+  static void emit(const nod::signal<void(std::shared_ptr<const buffer>)>& buffer_signal,
+                   const nod::signal<void(std::shared_ptr<std::vector<uint8_t>>)>& vector_signal,
+                   const std::shared_ptr<const buffer>& b) {
+    buffer_signal(b);
+
+    if (!vector_signal.empty()) {
+      vector_signal(std::make_shared<std::vector<uint8_t>>(std::begin(*b), std::end(*b)));
+    }
+  }
+
+  std::weak_ptr<dispatcher::dispatcher> weak_dispatcher_;
+  std::vector<std::vector<std::string>> stages_;
+  std::shared_ptr<reactor> reactor_;
+  bool stage_stderr_ = false;
+
+  std::vector<std::unique_ptr<process>> processes_;
+  std::mutex processes_mutex_;
+
+  // Accessed only on the dispatcher thread.
+  size_t exited_count_ = 0;
+  int last_status_ = 0;
+
+  std::atomic<bool> run_started_{false};
+};
+} // namespace pqrs::process
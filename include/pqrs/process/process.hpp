@@ -4,18 +4,39 @@
 // Distributed under the Boost Software License, Version 1.0.
 // (See https://www.boost.org/LICENSE_1_0.txt)
 
+#include "buffer_pool.hpp"
+#include "command_spec.hpp"
 #include "file_actions.hpp"
+#include "frame_assembler.hpp"
+#include "frame_differ.hpp"
+#include "line_framer.hpp"
 #include "pipe.hpp"
+#include "process_stats.hpp"
+#include "reactor.hpp"
+#include "resource_usage.hpp"
+#include "spawn_attributes.hpp"
+#include "stream_forwarder.hpp"
 #include <algorithm>
 #include <atomic>
 #include <cerrno>
+#include <chrono>
+#include <climits>
 #include <csignal>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <functional>
 #include <nod/nod.hpp>
 #include <optional>
 #include <poll.h>
 #include <pqrs/dispatcher.hpp>
+#include <pqrs/thread_wait.hpp>
+#include <pthread.h>
 #include <spawn.h>
+#include <span>
 #include <string>
+#include <string_view>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <thread>
 #include <unistd.h>
@@ -25,27 +46,73 @@
 extern char** environ;
 #endif
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
 namespace pqrs::process {
 // Capture the data using a signal for commands like top -l that produce output at regular intervals.
 class process final : public dispatcher::extra::dispatcher_client {
 public:
+  // The handlers for `enable_inline_delivery`.
+  struct inline_handlers final {
+    // The span is valid only while the handler is called.
+    std::function<void(std::span<const uint8_t>)> stdout_received;
+    std::function<void(std::span<const uint8_t>)> stderr_received;
+
+    // Called after all output has been delivered.
+    std::function<void(int status)> exited;
+  };
+
   // Signals (invoked from the dispatcher thread)
 
   nod::signal<void(std::shared_ptr<std::vector<uint8_t>>)> stdout_received;
   nod::signal<void(std::shared_ptr<std::vector<uint8_t>>)> stderr_received;
+
+  // The same chunks as `stdout_received` and `stderr_received` without copying.
+  // The buffer is shared by all slots and returns to the pool when the last reference is dropped.
+  nod::signal<void(std::shared_ptr<const buffer>)> stdout_buffer_received;
+  nod::signal<void(std::shared_ptr<const buffer>)> stderr_buffer_received;
+
+  // Complete lines without the delimiter (requires `enable_line_framing`).
+  // A line which is not terminated when the pipe is closed is also delivered.
+  // The string_view is valid only while the slot is called.
+  nod::signal<void(std::string_view)> stdout_line_received;
+  nod::signal<void(std::string_view)> stderr_line_received;
+
+  // The latest complete frame of stdout (requires `enable_frame_conflation`).
+  nod::signal<void(std::shared_ptr<const std::string>)> stdout_frame_received;
+
+  // The lines of the frame which differ from the previously delivered frame (requires `enable_frame_deltas`).
+  // This is emitted just after `stdout_frame_received`.
+  nod::signal<void(std::shared_ptr<const frame_delta>)> stdout_frame_delta_received;
+
+  // The data queued by `write_stdin` has been written to the pipe (requires `enable_stdin_pipe`).
+  nod::signal<void()> stdin_drained;
+
   nod::signal<void()> run_failed;
+
+  // The deadline set by `set_deadline` has passed while the process is running.
+  nod::signal<void()> timed_out;
+
+  // The status and the resource usage of the process. This is emitted just before `exited`.
+  nod::signal<void(int, const resource_usage&)> exited_with_usage;
+
   nod::signal<void(int)> exited;
 
   // Methods
 
   process(std::weak_ptr<dispatcher::dispatcher> weak_dispatcher,
           const std::vector<std::string>& argv)
+      : process(weak_dispatcher,
+                std::make_shared<command_spec>(argv)) {
+  }
+
+  // `spec` can be shared by many processes.
+  process(std::weak_ptr<dispatcher::dispatcher> weak_dispatcher,
+          std::shared_ptr<const command_spec> spec)
       : dispatcher_client(weak_dispatcher),
-        argv_buffer_(make_argv_buffer(argv)),
-        argv_(make_argv(argv_buffer_)),
-        stdout_pipe_(std::make_unique<pipe>()),
-        stderr_pipe_(std::make_unique<pipe>()),
-        file_actions_(make_file_actions(*stdout_pipe_, *stderr_pipe_)),
+        spec_(std::move(spec)),
         killed_(false) {
   }
 
@@ -81,14 +148,311 @@ private:
   }
 
 public:
-  void run() {
-    // `process` is a one-shot object. The pipes and file actions are created
-    // in the constructor and consumed by the first run, so subsequent runs fail.
+  // Register this process with a shared reactor instead of starting a dedicated polling thread.
+  // This must be called before `run`.
+  void set_reactor(std::shared_ptr<reactor> value) {
+    reactor_ = value;
+  }
+
+  // Assemble stdout into frames on the polling thread and deliver only the latest one through `stdout_frame_received`.
+  // At most one frame waits for the dispatcher. A frame which is superseded before it is delivered is dropped,
+  // so a slow consumer always receives the newest frame while the memory stays constant.
+  // The frame which is not terminated at the end of stdout is also delivered.
+  // stdout is not delivered through the other signals or `enable_inline_delivery` in this mode.
+  // This must be called before `run`.
+  void enable_frame_conflation(std::string delimiter,
+                               frame_delimiter_type type = frame_delimiter_type::separator) {
+    frame_assembler_.emplace(std::move(delimiter), type);
+  }
+
+  // Compare each delivered frame with the previous one and emit `stdout_frame_delta_received`,
+  // so that the consumers only process the lines which have changed (see `frame_differ`).
+  // The frames are compared on the dispatcher thread, against the frame which was delivered last rather than the dropped ones.
+  // This requires `enable_frame_conflation` and must be called before `run`.
+  void enable_frame_deltas() {
+    frame_differ_.emplace();
+  }
+
+  // The number of frames which were dropped in favor of a newer frame.
+  [[nodiscard]] uint64_t get_conflated_frame_count() const {
+    std::lock_guard<std::mutex> lock(frame_mutex_);
+
+    return conflated_frame_count_;
+  }
+
+  // Stop reading stdout and stderr while the chunks which have been read but not released by the consumers
+  // hold `max_bytes`, so that the full pipe blocks the child instead of the memory growing without limit.
+  // Each chunk is counted by the capacity of its pooled block (32 KiB) rather than its size,
+  // so that a child writing short lines cannot pile up many mostly empty blocks.
+  // Reading resumes when the consumers have released half of them.
+  // A chunk is released when the slots of `stdout_received` and the others have returned,
+  // or when the last reference to the buffer passed to `stdout_buffer_received` is dropped.
+  // The remaining output is read when the process exits, so the limit can be exceeded by the capacity of the pipes.
+  // This must be called before `run`.
+  void set_max_in_flight_bytes(size_t max_bytes) {
+    max_in_flight_bytes_ = std::max(max_bytes, size_t(1));
+  }
+
+  // The memory held by the chunks which have been read but not released by the consumers (see `set_max_in_flight_bytes`).
+  [[nodiscard]] size_t get_in_flight_bytes() const {
+    return in_flight_counter_->get_bytes();
+  }
+
+  // The number of the chunks which have been read but not released by the consumers.
+  [[nodiscard]] size_t get_queue_depth() const {
+    return in_flight_counter_->get_chunks();
+  }
+
+  // Accumulate small reads and deliver them as one chunk when `threshold_bytes` are pending
+  // or `max_delay` has passed since the first pending byte, whichever comes first.
+  // A child which writes tiny fragments then produces a few chunks instead of one per `read`.
+  // The threshold is capped at the block size of the buffer pool (32 KiB by default).
+  // The pending bytes are delivered before the stream is closed.
+  // This must be called before `run`.
+  void enable_coalescing(size_t threshold_bytes = 16 * 1024,
+                         std::chrono::milliseconds max_delay = std::chrono::milliseconds(10)) {
+    coalescing_ = coalescing{std::max(threshold_bytes, size_t(1)), max_delay};
+  }
+
+  // Set the capacity of the stdout and stderr pipes (the default is 64 KiB on Linux),
+  // so that a child which writes faster than it is read stalls less often.
+  // The kernel rounds the size up to a power of two pages. An unprivileged process cannot exceed /proc/sys/fs/pipe-max-size.
+  // This is ignored on systems without F_SETPIPE_SZ.
+  // This must be called before `run`.
+  void set_pipe_size(size_t bytes) {
+    pipe_size_ = bytes;
+  }
+
+  // Read into up to `max_blocks` pooled blocks with one `readv` per wakeup.
+  // The number of blocks doubles while the reads fill all of them, and halves when a read fills less than half of them,
+  // so a child which streams continuously is read with few system calls and an idle one with a single block.
+  // Each block is delivered as a separate chunk.
+  // This must be called before `run`.
+  void enable_adaptive_read(size_t max_blocks = 8) {
+    max_read_blocks_ = std::clamp(max_blocks, size_t(1), size_t(IOV_MAX));
+  }
+
+  // Spawn the process without copying the page tables of this process, which dominate the spawn latency
+  // when this process has a large resident set.
+  // This sets POSIX_SPAWN_USEVFORK where it is defined. glibc 2.24 or later and musl always spawn with
+  // clone(CLONE_VM | CLONE_VFORK), and posix_spawn on macOS is a system call, so the flag is only needed on older C libraries.
+  // This must be called before `run`.
+  void enable_fast_spawn() {
+    fast_spawn_ = true;
+  }
+
+  // Close all file descriptors other than stdin, stdout, and stderr in the child process,
+  // including the ones which this process opened without close-on-exec.
+  // This uses posix_spawn_file_actions_addclosefrom_np (close_range) on glibc 2.34 or later and
+  // POSIX_SPAWN_CLOEXEC_DEFAULT on macOS, and is ignored elsewhere.
+  // The pipes of `process` are always close-on-exec regardless of this.
+  // This must be called before `run`.
+  void enable_close_other_file_descriptors() {
+    close_other_file_descriptors_ = true;
+  }
+
+  // Send `signal` if the process is still running when `timeout` has elapsed since `run`,
+  // and SIGKILL if it is still running after `grace_period`.
+  // The output is read until SIGKILL is sent, so the output written while terminating is delivered.
+  // The timers run on the dispatcher and use its time source.
+  // This must be called before `run`.
+  void set_deadline(dispatcher::duration timeout,
+                    int signal = SIGTERM,
+                    dispatcher::duration grace_period = std::chrono::seconds(1)) {
+    deadline_ = deadline{timeout, signal, grace_period};
+  }
+
+  // Whether the deadline has passed while the process is running.
+  [[nodiscard]] bool get_timed_out() const {
+    return timed_out_;
+  }
+
+  // Invoke `handlers` synchronously on the polling thread instead of going through the dispatcher.
+  // The chunks are passed as spans of the pooled buffer, so no allocation, queueing, or thread switch is involved.
+  //
+  // In this mode:
+  // - The output is delivered only to `handlers`.
+  //   `stdout_received`, `stdout_buffer_received`, `stdout_line_received` and the stderr ones are not emitted.
+  // - `handlers.exited` is called on the polling thread, followed by `exited_with_usage` and `exited` on the dispatcher thread.
+  //
+  // Threading guarantees:
+  // - The handlers of a process are called one at a time on a single polling thread, in the order of the output.
+  //   Processes on the same reactor loop share that thread. Processes on different loops call their handlers concurrently.
+  // - All handlers have returned when `wait` returns.
+  // - The handlers block the polling of every process on the loop. They must not block, call `wait`, or destroy the process.
+  //   `kill`, `write_stdin` and `close_stdin` can be called.
+  //
+  // This must be called before `run`.
+  void enable_inline_delivery(inline_handlers handlers) {
+    inline_handlers_ = std::move(handlers);
+  }
+
+  // Collect `process_stats`. Without this, no statistics are collected.
+  // This must be called before `run`.
+  void enable_stats() {
+    stats_ = std::make_unique<impl::process_stats_collector>();
+  }
+
+  // Returns std::nullopt if `enable_stats` is not called.
+  [[nodiscard]] std::optional<process_stats> get_stats() const {
+    if (stats_) {
+      return stats_->get_stats();
+    }
+    return std::nullopt;
+  }
+
+  // Split stdout and stderr into lines on the polling thread, so that the dispatcher only receives complete lines.
+  // This must be called before `run`.
+  void enable_line_framing(char delimiter = '\n') {
+    stdout_line_framer_.emplace(delimiter);
+    stderr_line_framer_.emplace(delimiter);
+  }
+
+  // Create a pipe for stdin instead of inheriting the parent's stdin.
+  // The data passed to `write_stdin` is written by the polling thread without blocking,
+  // so large inputs do not deadlock against the stdout and stderr pipes.
+  // This must be called before `run`.
+  void enable_stdin_pipe(size_t max_queued_bytes = 1024 * 1024) {
+    if (stdin_pipe_) {
+      return;
+    }
+
+    stdin_pipe_ = std::make_unique<pipe>();
+    stdin_max_queued_bytes_ = max_queued_bytes;
+    stdin_redirection_ = std::nullopt;
+  }
+
+  // Connect stdin of the child process to `file_descriptor` instead of inheriting the parent's stdin.
+  // `file_descriptor` is owned by the caller and can be closed after `run`.
+  // This must be called before `run`.
+  void redirect_stdin(int file_descriptor) {
+    stdin_redirection_.emplace(file_descriptor);
+    stdin_pipe_ = nullptr;
+  }
+
+  // Open `path` as stdin in the child process.
+  void redirect_stdin(const std::string& path) {
+    stdin_redirection_.emplace(path, O_RDONLY, 0);
+    stdin_pipe_ = nullptr;
+  }
+
+  // Connect stdout of the child process to `file_descriptor` directly instead of a pipe.
+  // The output does not pass through this process, so the stdout signals are not emitted.
+  // `file_descriptor` is owned by the caller and can be closed after `run`.
+  // This must be called before `run`.
+  void redirect_stdout(int file_descriptor) {
+    stdout_redirection_.emplace(file_descriptor);
+    stdout_forwarder_ = nullptr;
+  }
+
+  // Open `path` as stdout in the child process.
+  void redirect_stdout(const std::string& path,
+                       int flags = O_WRONLY | O_CREAT | O_TRUNC,
+                       mode_t mode = 0644) {
+    stdout_redirection_.emplace(path, flags, mode);
+    stdout_forwarder_ = nullptr;
+  }
+
+  void redirect_stderr(int file_descriptor) {
+    stderr_redirection_.emplace(file_descriptor);
+    stderr_forwarder_ = nullptr;
+  }
+
+  void redirect_stderr(const std::string& path,
+                       int flags = O_WRONLY | O_CREAT | O_TRUNC,
+                       mode_t mode = 0644) {
+    stderr_redirection_.emplace(path, flags, mode);
+    stderr_forwarder_ = nullptr;
+  }
+
+  // Write stdout to `file_descriptor` on the polling thread, and emit the stdout signals as usual.
+  // See `stream_forwarder` for how the data is moved.
+  // The polling thread never blocks on `file_descriptor`. While it does not accept the data,
+  // stdout is not read, so the child blocks on the full pipe.
+  // The data is written before `exited` unless `kill` is called, which drops the data not written yet.
+  // `file_descriptor` is owned by the caller and must remain open until `wait` returns.
+  // This must be called before `run`.
+  void forward_stdout(int file_descriptor) {
+    stdout_forwarder_ = std::make_unique<stream_forwarder>(file_descriptor);
+    stdout_redirection_ = std::nullopt;
+  }
+
+  void forward_stderr(int file_descriptor) {
+    stderr_forwarder_ = std::make_unique<stream_forwarder>(file_descriptor);
+    stderr_redirection_ = std::nullopt;
+  }
+
+  // Queue `buffer` to be written to stdin.
+  // Returns false if the stdin pipe is not enabled, stdin is closed, or the queue is full.
+  // A buffer is always accepted when the queue is empty, even if it is larger than `max_queued_bytes`.
+  // Wait for `stdin_drained` and retry when the queue is full.
+  bool write_stdin(std::shared_ptr<const std::vector<uint8_t>> buffer) {
+    if (!stdin_pipe_ || !buffer) {
+      return false;
+    }
+
+    bool was_empty = false;
+
+    {
+      std::lock_guard<std::mutex> lock(stdin_mutex_);
+
+      if (stdin_closing_) {
+        return false;
+      }
+
+      if (buffer->empty()) {
+        return true;
+      }
+
+      if (stdin_queued_bytes_ > 0 &&
+          stdin_queued_bytes_ + buffer->size() > stdin_max_queued_bytes_) {
+        return false;
+      }
+
+      was_empty = stdin_queue_.empty();
+      stdin_queued_bytes_ += buffer->size();
+      stdin_queue_.push_back(std::move(buffer));
+    }
+
+    if (was_empty) {
+      post_to_loop([this] {
+        update_stdin();
+      });
+    }
+
+    return true;
+  }
+
+  bool write_stdin(std::string_view data) {
+    return write_stdin(std::make_shared<std::vector<uint8_t>>(std::begin(data), std::end(data)));
+  }
+
+  // Close stdin after the queued data is written.
+  void close_stdin() {
+    {
+      std::lock_guard<std::mutex> lock(stdin_mutex_);
+
+      if (!stdin_pipe_ || stdin_closing_) {
+        return;
+      }
+
+      stdin_closing_ = true;
+    }
+
+    post_to_loop([this] {
+      update_stdin();
+    });
+  }
+
+  // Returns false if the process could not be started (`run_failed` is also emitted).
+  bool run() {
+    // `process` is a one-shot object. The pipes and file actions are
+    // consumed by the first run, so subsequent runs fail.
     if (run_started_.exchange(true)) {
       enqueue_to_dispatcher([this] {
         run_failed();
       });
-      return;
+      return false;
     }
 
     killed_ = false;
@@ -96,165 +460,115 @@ public:
     //
     // Run failed immediately if no argv is specified.
     //
-    // Note:
-    // `argv_` is assembled by `make_argv`, which always appends a trailing `nullptr`,
-    // so its size is `1` when the original argv is empty.
-    //
 
-    if (argv_.size() <= 1 || !argv_[0]) {
+    if (!spec_ || spec_->empty()) {
       enqueue_to_dispatcher([this] {
         run_failed();
       });
-      return;
+      return false;
     }
 
     //
     // Spawn a process
     //
 
+    // The pipes are created here rather than in the constructor, so that constructing a process is cheap.
+    // A redirected stream does not use a pipe.
+    if (!stdout_redirection_) {
+      stdout_pipe_ = std::make_unique<pipe>();
+    }
+    if (!stderr_redirection_) {
+      stderr_pipe_ = std::make_unique<pipe>();
+    }
+    if (pipe_size_) {
+      for (const auto& p : {stdout_pipe_.get(), stderr_pipe_.get()}) {
+        if (p) {
+          p->set_capacity(*pipe_size_);
+        }
+      }
+    }
+
+    file_actions_ = make_file_actions();
+    spawn_attributes_ = make_spawn_attributes();
+
+    const auto envp = spec_->get_envp();
+    const auto spawn_start = stats_ ? impl::process_stats_collector::clock::now() : impl::process_stats_collector::clock::time_point();
+
     pid_t pid;
     if (posix_spawn(&pid,
-                    argv_[0],
+                    spec_->get_argv()[0],
                     file_actions_->get_actions(),
-                    nullptr,
-                    &(argv_[0]),
-                    environ) != 0) {
+                    spawn_attributes_->get_attributes(),
+                    spec_->get_argv(),
+                    envp ? envp : environ) != 0) {
       enqueue_to_dispatcher([this] {
         run_failed();
       });
-      return;
+      return false;
+    }
+
+    if (stats_) {
+      stats_->spawned(spawn_start, impl::process_stats_collector::clock::now());
     }
 
     set_pid(pid);
+    pidfd_ = open_pidfd(pid);
 
-    stdout_pipe_->close_write_end();
-    stderr_pipe_->close_write_end();
+    for (const auto& p : {stdout_pipe_.get(), stderr_pipe_.get()}) {
+      if (p) {
+        p->close_write_end();
+        p->set_read_end_nonblocking();
+      }
+    }
+
+    if (stdin_pipe_) {
+      stdin_pipe_->close_read_end();
+      stdin_pipe_->set_write_end_nonblocking();
+    }
 
-    // Start polling thread
+    // Start polling on the shared reactor, or on a dedicated thread if no reactor is set.
 
     {
       std::lock_guard<std::mutex> lock(thread_mutex_);
 
-      thread_ = std::make_shared<std::thread>([this] {
-        std::vector<pollfd> poll_file_descriptors;
-        const auto stdout_fd = stdout_pipe_->get_read_end();
-        const auto stderr_fd = stderr_pipe_->get_read_end();
-
-        if (stdout_fd) {
-          poll_file_descriptors.push_back({*stdout_fd, POLLIN, 0});
-        }
-        if (stderr_fd) {
-          poll_file_descriptors.push_back({*stderr_fd, POLLIN, 0});
-        }
-
-        if (!poll_file_descriptors.empty()) {
-          std::vector<uint8_t> buffer(32 * 1024);
-          constexpr int timeout = 500;
-          while (true) {
-            if (std::none_of(std::begin(poll_file_descriptors),
-                             std::end(poll_file_descriptors),
-                             [](const auto& poll_file_descriptor) {
-                               return poll_file_descriptor.fd != -1;
-                             })) {
-              break;
-            }
-
-            const auto poll_result = poll(poll_file_descriptors.data(), poll_file_descriptors.size(), timeout);
-
-            if (poll_result < 0) {
-              // Signals can interrupt poll/read while the child process is still
-              // running. If we stop draining pipes on EINTR, the child may block
-              // on a full pipe and waitpid can wait forever.
-              if (errno == EINTR) {
-                continue;
-              }
-              break;
-            } else if (poll_result == 0) {
-              // timeout
-              if (killed_) {
-                break;
-              }
-              continue;
-            }
-
-            bool received = false;
-
-            for (auto& poll_file_descriptor : poll_file_descriptors) {
-              if (poll_file_descriptor.fd == -1) {
-                continue;
-              }
-
-              if (poll_file_descriptor.revents & (POLLERR | POLLNVAL)) {
-                poll_file_descriptor.fd = -1;
-                poll_file_descriptor.events = 0;
-                poll_file_descriptor.revents = 0;
-                continue;
-              }
-
-              if (!(poll_file_descriptor.revents & (POLLIN | POLLHUP))) {
-                poll_file_descriptor.revents = 0;
-                continue;
-              }
-
-              const auto n = read(poll_file_descriptor.fd, buffer.data(), buffer.size());
-              if (n == 0) {
-                poll_file_descriptor.fd = -1;
-                poll_file_descriptor.events = 0;
-                poll_file_descriptor.revents = 0;
-                continue;
-              }
-              if (n < 0) {
-                if (errno == EINTR) {
-                  poll_file_descriptor.revents = 0;
-                  continue;
-                }
-                poll_file_descriptor.fd = -1;
-                poll_file_descriptor.events = 0;
-                poll_file_descriptor.revents = 0;
-                break;
-              }
-
-              const auto b = std::make_shared<std::vector<uint8_t>>(std::begin(buffer), std::begin(buffer) + n);
-
-              if (stdout_fd && poll_file_descriptor.fd == *stdout_fd) {
-                enqueue_to_dispatcher([this, b] {
-                  stdout_received(b);
-                });
-              } else if (stderr_fd && poll_file_descriptor.fd == *stderr_fd) {
-                enqueue_to_dispatcher([this, b] {
-                  stderr_received(b);
-                });
-              }
-
-              received = true;
-              poll_file_descriptor.revents = 0;
-            }
-
-            if (!received) {
-              continue;
-            }
-          }
-        }
-
-        // Wait process
+      finished_wait_ = make_thread_wait();
+
+      if (reactor_) {
+        loop_ = reactor_->get_loop();
+        buffer_pool_ = reactor_->get_buffer_pool();
+      } else {
+        loop_ = std::make_shared<event_loop>();
+        buffer_pool_ = std::make_shared<buffer_pool>(32 * 1024, std::max(size_t(4), max_read_blocks_ * 2));
+        thread_ = std::make_shared<std::thread>([l = loop_] {
+          l->run();
+        });
+      }
+    }
 
-        if (const auto pid = get_pid()) {
-          int stat;
-          pid_t waitpid_result;
-          do {
-            waitpid_result = waitpid(*pid, &stat, 0);
-          } while (waitpid_result == -1 && errno == EINTR);
+    // Install the handler before polling starts, so that `cleanup_process_resources` always clears it.
+    if (max_in_flight_bytes_) {
+      in_flight_counter_->set_resume_handler([this] {
+        post_to_loop([this] {
+          resume_reading();
+        });
+      });
+    }
 
-          if (waitpid_result == *pid) {
-            set_pid(std::nullopt);
+    loop_->post([this] {
+      start_polling();
+    });
 
-            enqueue_to_dispatcher([this, stat] {
-              exited(stat);
-            });
-          }
-        }
-      });
+    // Arm the deadline after the pid is set and polling is posted,
+    // so that a short timeout is not ignored by `handle_deadline` and its `kill` reaches the loop.
+    if (deadline_) {
+      enqueue_to_dispatcher(
+          [this] {
+            handle_deadline();
+          },
+          when_now() + deadline_->timeout);
     }
+
+    return true;
   }
 
   void kill(int signal) {
@@ -263,96 +577,1038 @@ public:
     if (const auto pid = get_pid()) {
       ::kill(*pid, signal);
     }
+
+    // Wake up the loop so that it stops polling the pipes immediately.
+    post_to_loop([this] {
+      stop_polling();
+    });
   }
 
+  // Wait until the pipes are closed (or the process exits if pidfd is available) and the process is reaped.
+  // `exited` has already been enqueued to the dispatcher when `wait` returns.
   void wait() {
+    std::shared_ptr<thread_wait> w;
     std::shared_ptr<std::thread> t;
 
     {
       std::lock_guard<std::mutex> lock(thread_mutex_);
 
+      w = finished_wait_;
       t = std::move(thread_);
     }
 
+    if (w) {
+      w->wait_notice();
+    }
+
     if (t && t->joinable()) {
       t->join();
     }
   }
 
 private:
+  // This method is called on the dispatcher thread.
+  void handle_deadline() {
+    const auto pid = get_pid();
+    if (!pid) {
+      // The process has already exited.
+      return;
+    }
+
+    timed_out_ = true;
+
+    if (deadline_->signal == SIGKILL) {
+      kill(SIGKILL);
+    } else {
+      // Keep polling so that the output written while terminating is delivered.
+      ::kill(*pid, deadline_->signal);
+
+      enqueue_to_dispatcher(
+          [this] {
+            if (get_pid()) {
+              kill(SIGKILL);
+            }
+          },
+          when_now() + deadline_->grace_period);
+    }
+
+    timed_out();
+  }
+
+  // Does nothing before `run`.
+  // The destructor waits for the posted functions, so they can capture `this`.
+  void post_to_loop(std::function<void()> function) {
+    std::shared_ptr<event_loop> l;
+    {
+      std::lock_guard<std::mutex> lock(thread_mutex_);
+
+      l = loop_;
+    }
+
+    if (l) {
+      l->post(std::move(function));
+    }
+  }
+
+  //
+  // The following methods are called on the loop thread.
+  //
+
+  // `enqueue_to_dispatcher` which records the dispatcher lag if stats are enabled.
+  void enqueue_signal(std::function<void()> function) {
+    if (!stats_) {
+      enqueue_to_dispatcher(std::move(function));
+      return;
+    }
+
+    enqueue_to_dispatcher([this, function = std::move(function), enqueued = impl::process_stats_collector::clock::now()] {
+      stats_->dispatcher_callback(impl::process_stats_collector::clock::now() - enqueued);
+      function();
+    });
+  }
+
+  void start_polling() {
+    stdout_fd_ = stdout_pipe_ ? stdout_pipe_->get_read_end() : std::nullopt;
+    stderr_fd_ = stderr_pipe_ ? stderr_pipe_->get_read_end() : std::nullopt;
+
+    for (auto fd : {&stdout_fd_, &stderr_fd_}) {
+      if (*fd && !add_stream(**fd)) {
+        fd->reset();
+      }
+    }
+
+    // With a pidfd, the exit is reported as an event and the process is reaped immediately,
+    // even if descendants keep stdout or stderr open.
+    if (pidfd_ &&
+        loop_->add(*pidfd_,
+                   POLLIN,
+                   [this](short) {
+                     handle_process_exited();
+                   })) {
+      polling_pidfd_ = pidfd_;
+    }
+
+    if (stdin_pipe_) {
+      stdin_fd_ = stdin_pipe_->get_write_end();
+      if (stdin_fd_) {
+#ifdef F_SETNOSIGPIPE
+        fcntl(*stdin_fd_, F_SETNOSIGPIPE, 1);
+#endif
+        if (!loop_->add(*stdin_fd_,
+                        0,
+                        [this](short revents) {
+                          // POLLHUP and POLLERR are reported even while POLLOUT is not polled,
+                          // so the pipe must be closed here when the process closes stdin.
+                          if (revents & (POLLHUP | POLLERR)) {
+                            close_stdin_pipe();
+                            return;
+                          }
+                          handle_stdin_writable();
+                        })) {
+          close_stdin_pipe();
+        }
+      }
+      update_stdin();
+    }
+
+    polling_ = true;
+
+    // `kill` may be called before the loop started polling.
+    if (killed_ ||
+        (!stdout_fd_ && !stderr_fd_)) {
+      stop_polling();
+    }
+  }
+
+  bool add_stream(int fd) {
+    return loop_->add(fd,
+                      POLLIN,
+                      [this, fd](short revents) {
+                        handle_readable(fd, revents);
+                      });
+  }
+
+  // Stop polling the streams while too many bytes are in flight.
+  // They are removed from the loop rather than modified, since a hang-up is reported regardless of the events.
+  void pause_reading() {
+    reading_paused_ = true;
+
+    for (auto fd : {stdout_fd_, stderr_fd_}) {
+      if (fd) {
+        loop_->remove(*fd);
+      }
+    }
+  }
+
+  void resume_reading() {
+    if (!reading_paused_) {
+      return;
+    }
+
+    reading_paused_ = false;
+
+    for (auto fd : {&stdout_fd_, &stderr_fd_}) {
+      if (*fd &&
+          !waiting_for_forwarder(fd == &stdout_fd_) &&
+          !add_stream(**fd)) {
+        close_stream(**fd);
+      }
+    }
+  }
+
+  [[nodiscard]] bool waiting_for_forwarder(bool is_stdout) const {
+    return is_stdout ? stdout_waiting_for_forwarder_ : stderr_waiting_for_forwarder_;
+  }
+
+  // Stop reading the stream until the target of the forwarder accepts the pending data,
+  // so that the child blocks on the full pipe instead of the loop thread blocking on the target.
+  void wait_for_forwarder(bool is_stdout) {
+    auto& waiting = is_stdout ? stdout_waiting_for_forwarder_ : stderr_waiting_for_forwarder_;
+    if (waiting) {
+      return;
+    }
+
+    const auto& forwarder = is_stdout ? stdout_forwarder_ : stderr_forwarder_;
+    const auto poll_fd = forwarder->get_poll_file_descriptor();
+    if (!poll_fd) {
+      return;
+    }
+
+    if (!loop_->add(*poll_fd,
+                    POLLOUT,
+                    [this, is_stdout](short) {
+                      handle_forwarder_writable(is_stdout);
+                    })) {
+      forwarder->fail(errno);
+      forwarder->close_poll_file_descriptor();
+      return;
+    }
+
+    waiting = true;
+
+    if (const auto fd = is_stdout ? stdout_fd_ : stderr_fd_) {
+      loop_->remove(*fd);
+    }
+  }
+
+  // POLLERR and POLLHUP are also handled here since `flush` fails on them.
+  void handle_forwarder_writable(bool is_stdout) {
+    const auto& forwarder = is_stdout ? stdout_forwarder_ : stderr_forwarder_;
+
+    block_sigpipe_on_current_thread();
+    if (!forwarder->flush()) {
+      return;
+    }
+
+    stop_waiting_for_forwarder(is_stdout);
+
+    auto& fd = is_stdout ? stdout_fd_ : stderr_fd_;
+    if (fd) {
+      if (!reading_paused_ && !add_stream(*fd)) {
+        close_stream(*fd);
+      }
+    } else if (!stdout_fd_ && !stderr_fd_ && !polling_pidfd_) {
+      // `reap` was deferred until the forwarded data is written.
+      reap();
+    }
+  }
+
+  void stop_waiting_for_forwarder(bool is_stdout) {
+    auto& waiting = is_stdout ? stdout_waiting_for_forwarder_ : stderr_waiting_for_forwarder_;
+    if (!waiting) {
+      return;
+    }
+
+    const auto& forwarder = is_stdout ? stdout_forwarder_ : stderr_forwarder_;
+    if (const auto poll_fd = forwarder->get_poll_file_descriptor()) {
+      loop_->remove(*poll_fd);
+    }
+    forwarder->close_poll_file_descriptor();
+    waiting = false;
+  }
+
+  void handle_readable(int fd, short revents) {
+    if (stats_) {
+      stats_->poll_event();
+    }
+
+    if (revents & (POLLERR | POLLNVAL)) {
+      close_stream(fd);
+      return;
+    }
+
+    if (!(revents & (POLLIN | POLLHUP))) {
+      return;
+    }
+
+    read_stream(fd);
+  }
+
+  // Returns the result of `read`.
+  ssize_t read_stream(int fd) {
+    const auto is_stdout = (stdout_fd_ && fd == *stdout_fd_);
+    const auto& forwarder = is_stdout ? stdout_forwarder_ : stderr_forwarder_;
+    auto& read_blocks = is_stdout ? stdout_read_blocks_ : stderr_read_blocks_;
+    if (forwarder) {
+      read_blocks = 1;
+    }
+
+    if (read_blocks > 1) {
+      return read_stream_vectored(fd, is_stdout, read_blocks);
+    }
+
+    auto b = buffer_pool_->acquire();
+
+    ssize_t n;
+    if (forwarder) {
+      block_sigpipe_on_current_thread();
+      n = forwarder->forward(fd, b->get_writable_data(), b->capacity());
+      if (forwarder->has_pending()) {
+        wait_for_forwarder(is_stdout);
+      }
+    } else {
+      n = read(fd, b->get_writable_data(), b->capacity());
+    }
+
+    if (n > 0 &&
+        static_cast<size_t>(n) == b->capacity() &&
+        !forwarder) {
+      read_blocks = std::min(size_t(2), max_read_blocks_);
+    }
+
+    if (stats_) {
+      stats_->read(is_stdout, n);
+    }
+    if (n == 0) {
+      close_stream(fd);
+      return n;
+    }
+    if (n < 0) {
+      // Signals can interrupt read while the child process is still running.
+      // The loop is level-triggered, so this handler will be called again.
+      if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+        return n;
+      }
+      close_stream(fd);
+      return n;
+    }
+
+    b->set_size(n);
+
+    if (stdout_fd_ && fd == *stdout_fd_) {
+      deliver_chunk(true, std::move(b));
+    } else if (stderr_fd_ && fd == *stderr_fd_) {
+      deliver_chunk(false, std::move(b));
+    }
+
+    return n;
+  }
+
+  // `read_stream` with `readv` into `read_blocks` blocks, which is adjusted for the next read.
+  ssize_t read_stream_vectored(int fd, bool is_stdout, size_t& read_blocks) {
+    read_buffers_.clear();
+    read_iovecs_.clear();
+    size_t capacity = 0;
+    for (size_t i = 0; i < read_blocks; ++i) {
+      auto& b = read_buffers_.emplace_back(buffer_pool_->acquire());
+      read_iovecs_.push_back(iovec{b->get_writable_data(), b->capacity()});
+      capacity += b->capacity();
+    }
+
+    const auto n = readv(fd, read_iovecs_.data(), static_cast<int>(read_iovecs_.size()));
+
+    if (stats_) {
+      stats_->read(is_stdout, n);
+    }
+    if (n <= 0) {
+      read_buffers_.clear();
+      if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return n;
+      }
+      close_stream(fd);
+      return n;
+    }
+
+    if (static_cast<size_t>(n) == capacity) {
+      read_blocks = std::min(read_blocks * 2, max_read_blocks_);
+    } else if (static_cast<size_t>(n) < capacity / 2) {
+      read_blocks = std::max(read_blocks / 2, size_t(1));
+    }
+
+    auto remaining = static_cast<size_t>(n);
+    for (auto& b : read_buffers_) {
+      if (remaining == 0) {
+        break;
+      }
+      b->set_size(std::min(remaining, b->capacity()));
+      remaining -= b->size();
+      deliver_chunk(is_stdout, std::move(b));
+    }
+    read_buffers_.clear();
+
+    return n;
+  }
+
+  void deliver_chunk(bool is_stdout, std::shared_ptr<buffer> b) {
+    if (!coalescing_) {
+      dispatch_chunk(is_stdout, std::move(b));
+      return;
+    }
+
+    auto& c = is_stdout ? stdout_coalescer_ : stderr_coalescer_;
+
+    if (!c.pending && b->size() >= coalescing_->threshold_bytes) {
+      dispatch_chunk(is_stdout, std::move(b));
+      return;
+    }
+
+    auto data = b->get_span();
+    while (!data.empty()) {
+      if (!c.pending) {
+        c.pending = buffer_pool_->acquire();
+      }
+
+      const auto n = std::min(data.size(), c.pending->capacity() - c.pending->size());
+      memcpy(c.pending->get_writable_data() + c.pending->size(), data.data(), n);
+      c.pending->set_size(c.pending->size() + n);
+      data = data.subspan(n);
+
+      if (c.pending->size() >= std::min(coalescing_->threshold_bytes, c.pending->capacity())) {
+        flush_coalesced(is_stdout);
+      }
+    }
+
+    if (c.pending && !c.timer) {
+      c.timer = loop_->add_timer(coalescing_->max_delay,
+                                 [this, is_stdout] {
+                                   (is_stdout ? stdout_coalescer_ : stderr_coalescer_).timer = std::nullopt;
+                                   flush_coalesced(is_stdout);
+                                 });
+    }
+  }
+
+  void flush_coalesced(bool is_stdout) {
+    auto& c = is_stdout ? stdout_coalescer_ : stderr_coalescer_;
+
+    if (c.timer) {
+      loop_->cancel_timer(*c.timer);
+      c.timer = std::nullopt;
+    }
+
+    if (c.pending) {
+      dispatch_chunk(is_stdout, std::exchange(c.pending, nullptr));
+    }
+  }
+
+  void dispatch_chunk(bool is_stdout, std::shared_ptr<buffer> b) {
+    if (is_stdout && frame_assembler_) {
+      const auto span = b->get_span();
+      publish_frame(frame_assembler_->append(std::string_view(reinterpret_cast<const char*>(span.data()),
+                                                              span.size())));
+      return;
+    }
+
+    if (inline_handlers_) {
+      const auto& handler = is_stdout ? inline_handlers_->stdout_received : inline_handlers_->stderr_received;
+      if (handler) {
+        handler(b->get_span());
+      }
+      return;
+    }
+
+    b->set_in_flight_counter(in_flight_counter_);
+
+    if (max_in_flight_bytes_ &&
+        !reading_paused_ &&
+        in_flight_counter_->pause_if_exceeded(*max_in_flight_bytes_, *max_in_flight_bytes_ / 2)) {
+      pause_reading();
+    }
+
+    std::shared_ptr<const line_batch> lines;
+    if (auto& framer = is_stdout ? stdout_line_framer_ : stderr_line_framer_) {
+      lines = framer->append(b);
+    }
+
+    enqueue_signal([this, is_stdout, b, lines] {
+      if (is_stdout) {
+        stdout_buffer_received(b);
+        emit_vector(stdout_received, *b);
+      } else {
+        stderr_buffer_received(b);
+        emit_vector(stderr_received, *b);
+      }
+
+      if (lines) {
+        emit_lines(is_stdout ? stdout_line_received : stderr_line_received, *lines);
+      }
+    });
+  }
+
+  // Replace the undelivered frame with `frame`, and enqueue the delivery if none is enqueued.
+  void publish_frame(std::optional<std::string> frame) {
+    bool enqueue = false;
+
+    {
+      std::lock_guard<std::mutex> lock(frame_mutex_);
+
+      conflated_frame_count_ = frame_assembler_->get_dropped_count() + conflated_by_queue_;
+
+      if (!frame) {
+        return;
+      }
+
+      if (latest_frame_) {
+        ++conflated_by_queue_;
+        ++conflated_frame_count_;
+      } else {
+        enqueue = true;
+      }
+      latest_frame_ = std::make_shared<const std::string>(std::move(*frame));
+    }
+
+    if (enqueue) {
+      enqueue_signal([this] {
+        std::shared_ptr<const std::string> f;
+        {
+          std::lock_guard<std::mutex> lock(frame_mutex_);
+
+          f = std::exchange(latest_frame_, nullptr);
+        }
+
+        if (f) {
+          stdout_frame_received(f);
+
+          if (frame_differ_) {
+            stdout_frame_delta_received(std::make_shared<const frame_delta>(frame_differ_->diff(f)));
+          }
+        }
+      });
+    }
+  }
+
+  void remove_stream(std::optional<int>& fd) {
+    loop_->remove(*fd);
+    fd.reset();
+
+    const auto is_stdout = (&fd == &stdout_fd_);
+    flush_coalesced(is_stdout);
+
+    if (is_stdout && frame_assembler_) {
+      publish_frame(frame_assembler_->flush());
+    }
+
+    if (auto& framer = is_stdout ? stdout_line_framer_ : stderr_line_framer_) {
+      if (auto lines = framer->flush()) {
+        enqueue_signal([this, is_stdout, lines] {
+          emit_lines(is_stdout ? stdout_line_received : stderr_line_received, *lines);
+        });
+      }
+    }
+  }
+
+  void close_stream(int fd) {
+    for (auto stream_fd : {&stdout_fd_, &stderr_fd_}) {
+      if (*stream_fd && **stream_fd == fd) {
+        remove_stream(*stream_fd);
+      }
+    }
+
+    if (!stdout_fd_ && !stderr_fd_ && !polling_pidfd_) {
+      reap();
+    }
+  }
+
+  void stop_polling() {
+    if (!polling_) {
+      return;
+    }
+
+    if (killed_) {
+      for (const auto is_stdout : {true, false}) {
+        if (waiting_for_forwarder(is_stdout)) {
+          stop_waiting_for_forwarder(is_stdout);
+          (is_stdout ? stdout_forwarder_ : stderr_forwarder_)->fail(ECANCELED);
+        }
+      }
+    }
+
+    for (auto fd : {&stdout_fd_, &stderr_fd_}) {
+      if (*fd) {
+        remove_stream(*fd);
+      }
+    }
+
+    if (stdin_fd_) {
+      close_stdin_pipe();
+    }
+
+    if (!polling_pidfd_) {
+      reap();
+    }
+  }
+
+  // Poll POLLOUT only while the queue has data.
+  void update_stdin() {
+    if (!stdin_fd_) {
+      return;
+    }
+
+    bool empty;
+    bool closing;
+    {
+      std::lock_guard<std::mutex> lock(stdin_mutex_);
+
+      empty = stdin_queue_.empty();
+      closing = stdin_closing_;
+    }
+
+    if (!empty) {
+      loop_->modify(*stdin_fd_, POLLOUT);
+    } else if (closing) {
+      close_stdin_pipe();
+    } else {
+      loop_->modify(*stdin_fd_, 0);
+    }
+  }
+
+  void handle_stdin_writable() {
+    if (!stdin_fd_) {
+      return;
+    }
+
+#ifndef F_SETNOSIGPIPE
+    block_sigpipe_on_current_thread();
+#endif
+
+    bool written = false;
+
+    while (true) {
+      // Only the loop thread pops the queue, so `front` stays in the queue while writing.
+      std::shared_ptr<const std::vector<uint8_t>> front;
+      size_t offset;
+      {
+        std::lock_guard<std::mutex> lock(stdin_mutex_);
+
+        if (stdin_queue_.empty()) {
+          break;
+        }
+
+        front = stdin_queue_.front();
+        offset = stdin_offset_;
+      }
+
+      const auto n = write(*stdin_fd_, front->data() + offset, front->size() - offset);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          break;
+        }
+        // EPIPE: the process closed stdin.
+        close_stdin_pipe();
+        return;
+      }
+
+      written = true;
+
+      {
+        std::lock_guard<std::mutex> lock(stdin_mutex_);
+
+        stdin_offset_ += n;
+        stdin_queued_bytes_ -= n;
+        if (stdin_offset_ == front->size()) {
+          stdin_queue_.pop_front();
+          stdin_offset_ = 0;
+        }
+      }
+    }
+
+    bool empty;
+    {
+      std::lock_guard<std::mutex> lock(stdin_mutex_);
+
+      empty = stdin_queue_.empty();
+    }
+
+    if (written && empty) {
+      enqueue_signal([this] {
+        stdin_drained();
+      });
+    }
+
+    update_stdin();
+  }
+
+  void close_stdin_pipe() {
+    if (stdin_fd_) {
+      loop_->remove(*stdin_fd_);
+      stdin_fd_ = std::nullopt;
+    }
+
+    stdin_pipe_->close_write_end();
+
+    std::lock_guard<std::mutex> lock(stdin_mutex_);
+
+    stdin_closing_ = true;
+    stdin_queue_.clear();
+    stdin_queued_bytes_ = 0;
+    stdin_offset_ = 0;
+  }
+
+  void handle_process_exited() {
+    // Deliver the data which the process wrote before exiting.
+    // Data written later by descendants which inherited the pipes is not delivered.
+    // The number of reads is bounded since descendants may keep writing.
+    for (auto fd : {&stdout_fd_, &stderr_fd_}) {
+      for (int i = 0; i < 64 && *fd && read_stream(**fd) > 0; ++i) {
+      }
+    }
+
+    loop_->remove(*polling_pidfd_);
+    polling_pidfd_ = std::nullopt;
+
+    stop_polling();
+  }
+
+  // The loop thread must not block in `wait4`, so the process is reaped with `WNOHANG`.
+  // If the process is still running (e.g., it closed stdout and stderr explicitly), retry with backoff.
+  void reap() {
+    if (reap_retry_timer_) {
+      // A retry is already scheduled.
+      return;
+    }
+
+    if (waiting_for_forwarder(true) || waiting_for_forwarder(false)) {
+      // `handle_forwarder_writable` calls `reap` after the forwarded data is written.
+      return;
+    }
+
+    if (const auto pid = get_pid()) {
+      int stat;
+      struct rusage usage{};
+      pid_t wait_result;
+      do {
+        wait_result = wait4(*pid, &stat, WNOHANG, &usage);
+      } while (wait_result == -1 && errno == EINTR);
+
+      if (wait_result == 0) {
+        reap_retry_timer_ = loop_->add_timer(reap_retry_interval_,
+                                             [this] {
+                                               reap_retry_timer_ = std::nullopt;
+                                               reap();
+                                             });
+        reap_retry_interval_ = std::min(reap_retry_interval_ * 2,
+                                        std::chrono::milliseconds(100));
+        return;
+      }
+
+      if (wait_result == *pid) {
+        set_pid(std::nullopt);
+
+        if (stats_) {
+          stats_->finished();
+        }
+
+        if (inline_handlers_ && inline_handlers_->exited) {
+          inline_handlers_->exited(stat);
+        }
+
+        enqueue_signal([this, stat, u = resource_usage::make(usage)] {
+          exited_with_usage(stat, u);
+          exited(stat);
+        });
+      }
+    }
+
+    finish_polling();
+  }
+
+  void finish_polling() {
+    polling_ = false;
+
+    if (stdin_fd_) {
+      close_stdin_pipe();
+    }
+
+    auto w = finished_wait_;
+
+    if (!reactor_) {
+      loop_->stop();
+    }
+
+    // `this` may be destroyed as soon as `notify` is called.
+    w->notify();
+  }
+
   void cleanup_process_resources() {
     kill(SIGKILL);
     wait();
 
+    // The consumers may release chunks after this process is destroyed.
+    // `set_resume_handler` waits for a running handler, and `run_sync` below executes the function it has posted.
+    in_flight_counter_->set_resume_handler(nullptr);
+
+    // Make sure that the functions posted by `kill` and the resume handler have been executed.
+    if (loop_) {
+      loop_->run_sync([] {});
+    }
+
+    if (pidfd_) {
+      close(*pidfd_);
+      pidfd_ = std::nullopt;
+    }
+
     file_actions_ = nullptr;
+    spawn_attributes_ = nullptr;
+    stdin_pipe_ = nullptr;
     stderr_pipe_ = nullptr;
     stdout_pipe_ = nullptr;
   }
 
-  static std::vector<std::vector<char>> make_argv_buffer(const std::vector<std::string>& argv) {
-    std::vector<std::vector<char>> buffer;
-    buffer.reserve(argv.size());
+  // The vector is created only if a slot is connected.
+  static void emit_vector(const nod::signal<void(std::shared_ptr<std::vector<uint8_t>>)>& signal,
+                          const buffer& b) {
+    if (!signal.empty()) {
+      signal(std::make_shared<std::vector<uint8_t>>(std::begin(b), std::end(b)));
+    }
+  }
+
+  static void emit_lines(const nod::signal<void(std::string_view)>& signal,
+                         const line_batch& lines) {
+    lines.for_each([&signal](auto&& line) {
+      signal(line);
+    });
+  }
+
+  // Writing to a pipe whose read end is closed raises SIGPIPE, which terminates the process by default.
+  // SIGPIPE is blocked on the loop thread so that `write` fails with EPIPE.
+  // The stdin pipe uses F_SETNOSIGPIPE instead where it is available.
+  static void block_sigpipe_on_current_thread() {
+    static thread_local bool blocked = false;
+
+    if (!blocked) {
+      sigset_t set;
+      sigemptyset(&set);
+      sigaddset(&set, SIGPIPE);
+      pthread_sigmask(SIG_BLOCK, &set, nullptr);
+      blocked = true;
+    }
+  }
+
+  // Returns std::nullopt if pidfd is not supported (non-Linux or Linux < 5.3).
+  static std::optional<int> open_pidfd([[maybe_unused]] pid_t pid) {
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    const auto fd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+    if (fd >= 0) {
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+      return fd;
+    }
+#endif
+    return std::nullopt;
+  }
+
+  std::unique_ptr<file_actions> make_file_actions() const {
+    auto actions = std::make_unique<file_actions>();
+
+#ifdef __APPLE__
+    if (close_other_file_descriptors_) {
+      // POSIX_SPAWN_CLOEXEC_DEFAULT closes the descriptors which are not explicitly inherited.
+      for (int fd = 0; fd <= 2; ++fd) {
+        actions->addinherit_np(fd);
+      }
+    }
+#endif
+
+    add_output_actions(*actions, stdout_pipe_.get(), stdout_redirection_, 1);
+    add_output_actions(*actions, stderr_pipe_.get(), stderr_redirection_, 2);
 
-    for (const auto& a : argv) {
-      std::vector<char> b(std::begin(a), std::end(a));
-      b.push_back('\0');
-      buffer.push_back(std::move(b));
+    if (stdin_redirection_) {
+      add_redirection_action(*actions, *stdin_redirection_, 0);
+    } else if (stdin_pipe_) {
+      if (const auto fd = stdin_pipe_->get_read_end()) {
+        actions->adddup2(*fd, 0);
+        actions->addclose(*fd);
+      }
+
+      if (const auto fd = stdin_pipe_->get_write_end()) {
+        actions->addclose(*fd);
+      }
     }
 
-    return buffer;
+#ifndef __APPLE__
+    if (close_other_file_descriptors_) {
+      // This must be the last action since the previous ones use the descriptors.
+      actions->addclosefrom(3);
+    }
+#endif
+
+    return actions;
   }
 
-  static std::vector<char*> make_argv(std::vector<std::vector<char>>& buffer) {
-    std::vector<char*> argv;
-    argv.reserve(buffer.size() + 1);
+  std::unique_ptr<spawn_attributes> make_spawn_attributes() const {
+    auto attributes = std::make_unique<spawn_attributes>();
 
-    for (auto&& b : buffer) {
-      argv.push_back(b.data());
+#ifdef POSIX_SPAWN_USEVFORK
+    if (fast_spawn_) {
+      attributes->addflags(POSIX_SPAWN_USEVFORK);
     }
+#endif
 
-    argv.push_back(nullptr);
+#ifdef POSIX_SPAWN_CLOEXEC_DEFAULT
+    if (close_other_file_descriptors_) {
+      attributes->addflags(POSIX_SPAWN_CLOEXEC_DEFAULT);
+    }
+#endif
 
-    return argv;
+    return attributes;
   }
 
-  static std::unique_ptr<file_actions> make_file_actions(const pipe& stdout_pipe,
-                                                         const pipe& stderr_pipe) {
-    auto actions = std::make_unique<file_actions>();
+  struct coalescing final {
+    size_t threshold_bytes;
+    std::chrono::milliseconds max_delay;
+  };
+
+  // The bytes which are waiting for `coalescing` thresholds.
+  struct coalescer final {
+    std::shared_ptr<buffer> pending;
+    std::optional<event_loop::timer_id> timer;
+  };
+
+  struct deadline final {
+    dispatcher::duration timeout;
+    int signal;
+    dispatcher::duration grace_period;
+  };
+
+  // The constructors keep every member explicitly initialized,
+  // so that the users building with -Wextra do not get -Wmissing-field-initializers.
+  struct redirection final {
+    explicit redirection(int file_descriptor)
+        : file_descriptor(file_descriptor) {
+    }
+
+    redirection(const std::string& path,
+                int flags,
+                mode_t mode)
+        : path(path),
+          flags(flags),
+          mode(mode) {
+    }
 
-    if (const auto fd = stdout_pipe.get_read_end()) {
-      actions->addclose(*fd);
+    std::optional<int> file_descriptor;
+    std::string path;
+    int flags = 0;
+    mode_t mode = 0;
+  };
+
+  static void add_redirection_action(file_actions& actions,
+                                     const redirection& r,
+                                     int target_file_descriptor) {
+    if (r.file_descriptor) {
+      actions.adddup2(*r.file_descriptor, target_file_descriptor);
+    } else {
+      actions.addopen(target_file_descriptor,
+                      r.path.c_str(),
+                      r.flags,
+                      r.mode);
     }
+  }
 
-    if (const auto fd = stdout_pipe.get_write_end()) {
-      actions->adddup2(*fd, 1);
-      actions->addclose(*fd);
+  static void add_output_actions(file_actions& actions,
+                                 const pipe* output_pipe,
+                                 const std::optional<redirection>& output_redirection,
+                                 int target_file_descriptor) {
+    if (output_redirection) {
+      add_redirection_action(actions, *output_redirection, target_file_descriptor);
+      return;
     }
 
-    if (const auto fd = stderr_pipe.get_read_end()) {
-      actions->addclose(*fd);
+    if (!output_pipe) {
+      return;
     }
 
-    if (const auto fd = stderr_pipe.get_write_end()) {
-      actions->adddup2(*fd, 2);
-      actions->addclose(*fd);
+    if (const auto fd = output_pipe->get_read_end()) {
+      actions.addclose(*fd);
     }
 
-    return actions;
+    if (const auto fd = output_pipe->get_write_end()) {
+      actions.adddup2(*fd, target_file_descriptor);
+      actions.addclose(*fd);
+    }
   }
 
-  std::vector<std::vector<char>> argv_buffer_;
-  std::vector<char*> argv_;
+  std::shared_ptr<const command_spec> spec_;
 
+  std::unique_ptr<pipe> stdin_pipe_;
   std::unique_ptr<pipe> stdout_pipe_;
   std::unique_ptr<pipe> stderr_pipe_;
   std::unique_ptr<file_actions> file_actions_;
+  std::unique_ptr<spawn_attributes> spawn_attributes_;
+  bool fast_spawn_ = false;
+  bool close_other_file_descriptors_ = false;
+  std::optional<size_t> pipe_size_;
+  std::optional<coalescing> coalescing_;
+  std::optional<size_t> max_in_flight_bytes_;
+  std::optional<frame_assembler> frame_assembler_;
+  // Accessed only on the dispatcher thread after `run`.
+  std::optional<frame_differ> frame_differ_;
+  std::shared_ptr<const std::string> latest_frame_;
+  uint64_t conflated_by_queue_ = 0;
+  uint64_t conflated_frame_count_ = 0;
+  mutable std::mutex frame_mutex_;
+  std::shared_ptr<impl::in_flight_counter> in_flight_counter_ = std::make_shared<impl::in_flight_counter>();
+  size_t max_read_blocks_ = 1;
+  std::unique_ptr<impl::process_stats_collector> stats_;
+  std::optional<deadline> deadline_;
+  std::atomic<bool> timed_out_{false};
+
+  std::optional<redirection> stdin_redirection_;
+  std::optional<redirection> stdout_redirection_;
+  std::optional<redirection> stderr_redirection_;
+  std::unique_ptr<stream_forwarder> stdout_forwarder_;
+  std::unique_ptr<stream_forwarder> stderr_forwarder_;
+  bool stdout_waiting_for_forwarder_ = false;
+  bool stderr_waiting_for_forwarder_ = false;
 
   std::optional<pid_t> pid_;
   mutable std::mutex pid_mutex_;
+  std::optional<int> pidfd_;
+
+  std::shared_ptr<reactor> reactor_;
+  std::shared_ptr<event_loop> loop_;
+  std::shared_ptr<buffer_pool> buffer_pool_;
+  std::shared_ptr<thread_wait> finished_wait_;
 
   std::shared_ptr<std::thread> thread_;
   mutable std::mutex thread_mutex_;
 
+  std::deque<std::shared_ptr<const std::vector<uint8_t>>> stdin_queue_;
+  size_t stdin_offset_ = 0;
+  size_t stdin_queued_bytes_ = 0;
+  size_t stdin_max_queued_bytes_ = 0;
+  bool stdin_closing_ = false;
+  std::mutex stdin_mutex_;
+
+  // Accessed only on the loop thread.
+  std::optional<int> stdout_fd_;
+  std::optional<int> stderr_fd_;
+  std::optional<int> stdin_fd_;
+  std::optional<int> polling_pidfd_;
+  std::optional<line_framer> stdout_line_framer_;
+  std::optional<line_framer> stderr_line_framer_;
+  std::optional<inline_handlers> inline_handlers_;
+  coalescer stdout_coalescer_;
+  coalescer stderr_coalescer_;
+  bool reading_paused_ = false;
+  size_t stdout_read_blocks_ = 1;
+  size_t stderr_read_blocks_ = 1;
+  std::vector<std::shared_ptr<buffer>> read_buffers_;
+  std::vector<iovec> read_iovecs_;
+  bool polling_ = false;
+  std::optional<event_loop::timer_id> reap_retry_timer_;
+  std::chrono::milliseconds reap_retry_interval_{1};
+
   std::atomic<bool> killed_;
   std::atomic<bool> run_started_{false};
 };
@@ -0,0 +1,188 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+// `pqrs::process::process_reader` can be used safely in a multi-threaded environment.
+
+#include "executor.hpp"
+#include "process.hpp"
+#include <coroutine>
+#include <mutex>
+#include <nod/nod.hpp>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pqrs::process {
+// Awaitable reads of the stdout or stderr of a running `process`.
+//
+//   pqrs::process::process_reader reader(dispatcher, p);
+//   p.run();
+//   while (auto line = co_await reader.read_line()) {
+//     ...
+//   }
+//
+// Construct the reader before `run` so that no output is missed.
+// The output is buffered until it is read. The end of the output is the exit of the process.
+// Only one coroutine can wait on a reader at a time.
+// The coroutine is resumed on the dispatcher thread, or through `resume_executor` if it is given.
+//
+// Destroy the reader on the dispatcher thread or after the process has exited.
+class process_reader final : public dispatcher::extra::dispatcher_client {
+public:
+  enum class stream {
+    standard_output,
+    standard_error,
+  };
+
+  class awaitable final {
+  public:
+    awaitable(process_reader& reader, bool line)
+        : reader_(reader),
+          line_(line) {
+    }
+
+    [[nodiscard]] bool await_ready() const {
+      std::lock_guard<std::mutex> lock(reader_.mutex_);
+
+      return reader_.ready(line_);
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+      std::lock_guard<std::mutex> lock(reader_.mutex_);
+
+      if (reader_.ready(line_)) {
+        return false;
+      }
+
+      reader_.handle_ = handle;
+      reader_.waiting_line_ = line_;
+      return true;
+    }
+
+    [[nodiscard]] std::optional<std::string> await_resume() {
+      std::lock_guard<std::mutex> lock(reader_.mutex_);
+
+      return reader_.take(line_);
+    }
+
+  private:
+    process_reader& reader_;
+    bool line_;
+  };
+
+  process_reader(std::weak_ptr<dispatcher::dispatcher> weak_dispatcher,
+                 process& p,
+                 stream s = stream::standard_output,
+                 executor resume_executor = nullptr)
+      : dispatcher_client(weak_dispatcher),
+        resume_executor_(std::move(resume_executor)) {
+    auto& received = (s == stream::standard_output) ? p.stdout_buffer_received : p.stderr_buffer_received;
+    connections_.emplace_back(received.connect([this](auto&& buffer) {
+      const auto data = buffer->get_span();
+      std::unique_lock<std::mutex> lock(mutex_);
+      buffer_.append(reinterpret_cast<const char*>(data.data()), data.size());
+      notify(lock);
+    }));
+
+    const auto finish = [this] {
+      std::unique_lock<std::mutex> lock(mutex_);
+      eof_ = true;
+      notify(lock);
+    };
+    connections_.emplace_back(p.run_failed.connect(finish));
+    connections_.emplace_back(p.exited.connect([finish](auto&&) {
+      finish();
+    }));
+  }
+
+  ~process_reader() override {
+    connections_.clear();
+    detach_from_dispatcher();
+  }
+
+  process_reader(const process_reader&) = delete;
+  process_reader(process_reader&&) = delete;
+  process_reader& operator=(const process_reader&) = delete;
+  process_reader& operator=(process_reader&&) = delete;
+
+  // Returns all buffered output, waiting for the output if none is buffered.
+  // Returns std::nullopt at the end of the output.
+  [[nodiscard]] awaitable read_some() {
+    return awaitable(*this, false);
+  }
+
+  // Returns the next line without the trailing newline.
+  // The last line is returned without waiting for a newline at the end of the output.
+  // Returns std::nullopt at the end of the output.
+  [[nodiscard]] awaitable read_line() {
+    return awaitable(*this, true);
+  }
+
+private:
+  // The following methods are called with `mutex_` locked.
+
+  bool ready(bool line) const {
+    if (eof_) {
+      return true;
+    }
+
+    if (line) {
+      return buffer_.find('\n') != std::string::npos;
+    }
+
+    return !buffer_.empty();
+  }
+
+  std::optional<std::string> take(bool line) {
+    if (line) {
+      const auto pos = buffer_.find('\n');
+      if (pos != std::string::npos) {
+        auto result = buffer_.substr(0, pos);
+        buffer_.erase(0, pos + 1);
+        return result;
+      }
+    }
+
+    if (buffer_.empty()) {
+      return std::nullopt;
+    }
+
+    return std::exchange(buffer_, std::string());
+  }
+
+  // Resume the waiting coroutine if its read can be completed.
+  // `lock` is released before resuming.
+  void notify(std::unique_lock<std::mutex>& lock) {
+    if (!handle_ || !ready(waiting_line_)) {
+      return;
+    }
+
+    auto handle = std::exchange(handle_, nullptr);
+    lock.unlock();
+
+    // The signal handlers are invoked while the process emits a signal.
+    // Resume the coroutine after that since it may destroy the process.
+    auto function = [handle] {
+      handle.resume();
+    };
+    if (resume_executor_) {
+      resume_executor_(function);
+    } else {
+      enqueue_to_dispatcher(function);
+    }
+  }
+
+  executor resume_executor_;
+  std::vector<nod::scoped_connection> connections_;
+
+  std::string buffer_;
+  bool eof_ = false;
+  std::coroutine_handle<> handle_;
+  bool waiting_line_ = false;
+  mutable std::mutex mutex_;
+};
+} // namespace pqrs::process
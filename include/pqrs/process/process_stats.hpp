@@ -0,0 +1,123 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+// `pqrs::process::impl::process_stats_collector` can be used safely in a multi-threaded environment.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <unistd.h>
+
+namespace pqrs::process {
+// A snapshot of the runtime statistics of a process (see `process::enable_stats`).
+struct process_stats final {
+  // The time spent in `posix_spawn`.
+  std::chrono::nanoseconds spawn_duration{0};
+
+  // The bytes and the chunks delivered from each stream.
+  uint64_t stdout_bytes = 0;
+  uint64_t stdout_chunks = 0;
+  uint64_t stderr_bytes = 0;
+  uint64_t stderr_chunks = 0;
+
+  // The number of `read` calls on stdout and stderr, including the ones which returned EAGAIN or EOF.
+  uint64_t read_count = 0;
+
+  // The number of readiness events of this process which the event loop delivered.
+  // The loop is shared by the processes on a reactor, so this is not the number of `poll` calls.
+  uint64_t poll_event_count = 0;
+
+  // The time from enqueueing a signal on the polling thread to invoking it on the dispatcher thread.
+  uint64_t dispatcher_callback_count = 0;
+  std::chrono::nanoseconds max_dispatcher_lag{0};
+  std::chrono::nanoseconds average_dispatcher_lag{0};
+
+  // The time from the spawn to the first byte of stdout or stderr.
+  std::optional<std::chrono::nanoseconds> time_to_first_byte;
+
+  // The time from the spawn to the exit, or to now while the process is running.
+  std::chrono::nanoseconds wall_time{0};
+};
+
+namespace impl {
+class process_stats_collector final {
+public:
+  using clock = std::chrono::steady_clock;
+
+  void spawned(clock::time_point start, clock::time_point end) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    spawned_time_ = end;
+    stats_.spawn_duration = end - start;
+  }
+
+  void finished() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    finished_time_ = clock::now();
+  }
+
+  // `result` is the return value of `read`.
+  void read(bool is_stdout, ssize_t result) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    ++stats_.read_count;
+
+    if (result > 0) {
+      auto& bytes = is_stdout ? stats_.stdout_bytes : stats_.stderr_bytes;
+      auto& chunks = is_stdout ? stats_.stdout_chunks : stats_.stderr_chunks;
+      bytes += result;
+      ++chunks;
+
+      if (!stats_.time_to_first_byte && spawned_time_) {
+        stats_.time_to_first_byte = clock::now() - *spawned_time_;
+      }
+    }
+  }
+
+  void poll_event() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    ++stats_.poll_event_count;
+  }
+
+  void dispatcher_callback(clock::duration lag) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    ++stats_.dispatcher_callback_count;
+    stats_.max_dispatcher_lag = std::max(stats_.max_dispatcher_lag,
+                                         std::chrono::duration_cast<std::chrono::nanoseconds>(lag));
+    total_dispatcher_lag_ += lag;
+  }
+
+  [[nodiscard]] process_stats get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto s = stats_;
+
+    if (s.dispatcher_callback_count > 0) {
+      s.average_dispatcher_lag = std::chrono::duration_cast<std::chrono::nanoseconds>(total_dispatcher_lag_) /
+                                 s.dispatcher_callback_count;
+    }
+
+    if (spawned_time_) {
+      s.wall_time = finished_time_.value_or(clock::now()) - *spawned_time_;
+    }
+
+    return s;
+  }
+
+private:
+  process_stats stats_;
+  clock::duration total_dispatcher_lag_{0};
+  std::optional<clock::time_point> spawned_time_;
+  std::optional<clock::time_point> finished_time_;
+  mutable std::mutex mutex_;
+};
+} // namespace impl
+} // namespace pqrs::process
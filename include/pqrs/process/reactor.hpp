@@ -0,0 +1,72 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+// `pqrs::process::reactor` can be used safely in a multi-threaded environment.
+
+#include "buffer_pool.hpp"
+#include "event_loop.hpp"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace pqrs::process {
+// A fixed set of event loops shared by many `process` instances.
+// Each process is assigned to one loop, so all events of a process are handled on the same thread.
+class reactor final {
+public:
+  explicit reactor(size_t loop_count = 1)
+      : buffer_pool_(std::make_shared<buffer_pool>()) {
+    loop_count = std::max(loop_count, static_cast<size_t>(1));
+
+    for (size_t i = 0; i < loop_count; ++i) {
+      auto l = std::make_shared<event_loop>();
+      loops_.push_back(l);
+      threads_.emplace_back([l] {
+        l->run();
+      });
+    }
+  }
+
+  ~reactor() {
+    for (auto&& l : loops_) {
+      l->stop();
+    }
+
+    for (auto&& t : threads_) {
+      if (t.joinable()) {
+        t.join();
+      }
+    }
+  }
+
+  reactor(const reactor&) = delete;
+  reactor(reactor&&) = delete;
+  reactor& operator=(const reactor&) = delete;
+  reactor& operator=(reactor&&) = delete;
+
+  [[nodiscard]] size_t get_loop_count() const {
+    return loops_.size();
+  }
+
+  // Loops are assigned in round-robin order.
+  [[nodiscard]] std::shared_ptr<event_loop> get_loop() {
+    return loops_[next_loop_index_++ % loops_.size()];
+  }
+
+  // The buffers for the output of the processes are shared among all loops.
+  [[nodiscard]] std::shared_ptr<buffer_pool> get_buffer_pool() const {
+    return buffer_pool_;
+  }
+
+private:
+  std::shared_ptr<buffer_pool> buffer_pool_;
+  std::vector<std::shared_ptr<event_loop>> loops_;
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> next_loop_index_{0};
+};
+} // namespace pqrs::process
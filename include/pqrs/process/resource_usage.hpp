@@ -0,0 +1,50 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+#include <chrono>
+#include <cstdint>
+#include <sys/resource.h>
+
+namespace pqrs::process {
+// The resource usage of an exited process, taken from `struct rusage`.
+struct resource_usage final {
+  std::chrono::microseconds user_time{0};
+  std::chrono::microseconds system_time{0};
+
+  // `ru_maxrss` is in kilobytes on Linux and in bytes on macOS. This is always in bytes.
+  uint64_t max_rss_bytes = 0;
+
+  uint64_t minor_page_faults = 0;
+  uint64_t major_page_faults = 0;
+  uint64_t block_input_operations = 0;
+  uint64_t block_output_operations = 0;
+  uint64_t voluntary_context_switches = 0;
+  uint64_t involuntary_context_switches = 0;
+
+  static resource_usage make(const struct rusage& usage) {
+    resource_usage u;
+    u.user_time = to_microseconds(usage.ru_utime);
+    u.system_time = to_microseconds(usage.ru_stime);
+#ifdef __APPLE__
+    u.max_rss_bytes = usage.ru_maxrss;
+#else
+    u.max_rss_bytes = static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+    u.minor_page_faults = usage.ru_minflt;
+    u.major_page_faults = usage.ru_majflt;
+    u.block_input_operations = usage.ru_inblock;
+    u.block_output_operations = usage.ru_oublock;
+    u.voluntary_context_switches = usage.ru_nvcsw;
+    u.involuntary_context_switches = usage.ru_nivcsw;
+    return u;
+  }
+
+private:
+  static std::chrono::microseconds to_microseconds(const struct timeval& tv) {
+    return std::chrono::seconds(tv.tv_sec) + std::chrono::microseconds(tv.tv_usec);
+  }
+};
+} // namespace pqrs::process
@@ -0,0 +1,48 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+#include <spawn.h>
+
+namespace pqrs::process {
+class spawn_attributes final {
+public:
+  spawn_attributes() noexcept {
+    posix_spawnattr_init(&attributes_);
+  }
+
+  ~spawn_attributes() noexcept {
+    posix_spawnattr_destroy(&attributes_);
+  }
+
+  spawn_attributes(const spawn_attributes&) = delete;
+  spawn_attributes(spawn_attributes&&) = delete;
+  spawn_attributes& operator=(const spawn_attributes&) = delete;
+  spawn_attributes& operator=(spawn_attributes&&) = delete;
+
+  [[nodiscard]] posix_spawnattr_t* get_attributes() noexcept {
+    return &attributes_;
+  }
+
+  [[nodiscard]] short getflags() const noexcept {
+    short flags = 0;
+    posix_spawnattr_getflags(&attributes_, &flags);
+    return flags;
+  }
+
+  int setflags(short flags) noexcept {
+    return posix_spawnattr_setflags(&attributes_,
+                                    flags);
+  }
+
+  // Add `flags` to the current flags.
+  int addflags(short flags) noexcept {
+    return setflags(getflags() | flags);
+  }
+
+private:
+  posix_spawnattr_t attributes_;
+};
+} // namespace pqrs::process
@@ -0,0 +1,285 @@
+#pragma once
+
+// (C) Copyright Takayama Fumihiko 2026.
+// Distributed under the Boost Software License, Version 1.0.
+// (See https://www.boost.org/LICENSE_1_0.txt)
+
+// `pqrs::process::stream_forwarder` is not thread-safe.
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <fcntl.h>
+#include <optional>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace pqrs::process {
+// Forward the data read from a pipe to another file descriptor, and keep a copy for the caller.
+// On Linux, the data is duplicated with `tee` and moved to the target with `splice`,
+// so the bytes written to the target do not pass through user space.
+// Elsewhere, or if the target does not support `splice`, the copy is written with `write`.
+//
+// The target is never waited for, even if it is a blocking descriptor:
+// sockets are written with MSG_DONTWAIT, and blocking pipes and terminals only while poll reports POLLOUT.
+// The data which the target does not accept is kept until `flush` writes it,
+// and the caller stops reading `source` meanwhile (see `has_pending` and `get_poll_file_descriptor`).
+class stream_forwarder final {
+public:
+  explicit stream_forwarder(int target_file_descriptor)
+      : target_(target_file_descriptor) {
+    struct stat st{};
+    const auto stat_result = fstat(target_, &st);
+    const auto flags = fcntl(target_, F_GETFL);
+
+    if (stat_result == 0) {
+      is_socket_ = S_ISSOCK(st.st_mode);
+      // Writing to regular files and block devices does not wait for a reader.
+      may_block_ = !S_ISREG(st.st_mode) && !S_ISBLK(st.st_mode);
+    }
+    nonblocking_ = (flags != -1 && (flags & O_NONBLOCK));
+
+#ifdef __linux__
+    // `splice` into a file opened with O_APPEND fails with EINVAL on older kernels.
+    // Sockets are excluded since older kernels ignore SPLICE_F_NONBLOCK for them.
+    if (stat_result == 0 &&
+        (S_ISREG(st.st_mode) || S_ISFIFO(st.st_mode)) &&
+        flags != -1 &&
+        !(flags & O_APPEND) &&
+        ::pipe2(tee_pipe_.data(), O_CLOEXEC) == 0) {
+      use_splice_ = true;
+    }
+#endif
+  }
+
+  ~stream_forwarder() {
+    for (auto fd : tee_pipe_) {
+      if (fd != -1) {
+        close(fd);
+      }
+    }
+
+    close_poll_file_descriptor();
+  }
+
+  stream_forwarder(const stream_forwarder&) = delete;
+  stream_forwarder(stream_forwarder&&) = delete;
+  stream_forwarder& operator=(const stream_forwarder&) = delete;
+  stream_forwarder& operator=(stream_forwarder&&) = delete;
+
+  [[nodiscard]] int get_target_file_descriptor() const noexcept {
+    return target_;
+  }
+
+  // The first error of writing to the target. Nothing is written to the target after an error.
+  [[nodiscard]] int get_error() const noexcept {
+    return error_;
+  }
+
+  // Whether some data is waiting for the target to become writable.
+  [[nodiscard]] bool has_pending() const noexcept {
+    return !pending_.empty();
+  }
+
+  // A duplicate of the target to poll for POLLOUT while `has_pending`.
+  // The event loop identifies the entries by the descriptor, so the target itself is not used.
+  // Returns std::nullopt if it cannot be created, and the forwarder fails with the error in that case.
+  // Close it with `close_poll_file_descriptor` after polling, since it keeps the target open.
+  std::optional<int> get_poll_file_descriptor() {
+    if (poll_file_descriptor_ == -1) {
+      poll_file_descriptor_ = fcntl(target_, F_DUPFD_CLOEXEC, 0);
+      if (poll_file_descriptor_ == -1) {
+        fail(errno);
+        return std::nullopt;
+      }
+    }
+    return poll_file_descriptor_;
+  }
+
+  void close_poll_file_descriptor() {
+    if (poll_file_descriptor_ != -1) {
+      close(poll_file_descriptor_);
+      poll_file_descriptor_ = -1;
+    }
+  }
+
+  // Write the pending data as far as the target accepts it.
+  // Returns true if no data is pending anymore, including when writing has failed.
+  bool flush() {
+    while (error_ == 0 && pending_offset_ < pending_.size()) {
+      const auto n = write_some(pending_.data() + pending_offset_, pending_.size() - pending_offset_);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          return false;
+        }
+        fail(errno);
+        break;
+      }
+      pending_offset_ += n;
+    }
+
+    pending_.clear();
+    pending_offset_ = 0;
+    return true;
+  }
+
+  // Drop the pending data and stop forwarding.
+  void fail(int error) {
+    if (error_ == 0) {
+      error_ = error;
+    }
+    pending_.clear();
+    pending_offset_ = 0;
+  }
+
+  // Read at most `size` bytes from `source` (a non-blocking pipe) into `data`, and write them to the target.
+  // The bytes which the target does not accept are appended to the pending data.
+  // Returns the result of `read`.
+  ssize_t forward(int source, uint8_t* data, size_t size) {
+#ifdef __linux__
+    if (use_splice_ && error_ == 0 && pending_.empty()) {
+      const auto n = tee(source, tee_pipe_[1], size, SPLICE_F_NONBLOCK);
+      if (n >= 0 || errno == EAGAIN || errno == EINTR) {
+        return n > 0 ? splice_teed_data(source, data, n) : n;
+      }
+
+      use_splice_ = false;
+    }
+#endif
+
+    const auto n = read(source, data, size);
+    if (n > 0) {
+      write_or_queue(data, n);
+    }
+    return n;
+  }
+
+private:
+#ifdef __linux__
+  // `size` bytes are in both `source` and the tee pipe.
+  ssize_t splice_teed_data(int source, uint8_t* data, size_t size) {
+    // The copy for the caller.
+    size_t copied = 0;
+    while (copied < size) {
+      const auto n = read(tee_pipe_[0], data + copied, size - copied);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        break;
+      }
+      copied += n;
+    }
+
+    // Move the same bytes from `source` to the target.
+    size_t moved = 0;
+    while (moved < size) {
+      const auto n = splice(source, nullptr, target_, nullptr, size - moved, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (n > 0) {
+        moved += n;
+        continue;
+      }
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+
+      // The target is full, does not support `splice`, or failed to be written.
+      // Consume the rest from `source` (the same bytes as the copy) and write or queue it.
+      if (n == 0 || errno != EAGAIN) {
+        use_splice_ = false;
+      }
+
+      while (moved < size) {
+        const auto r = read(source, data + moved, size - moved);
+        if (r < 0 && errno == EINTR) {
+          continue;
+        }
+        if (r <= 0) {
+          break;
+        }
+        write_or_queue(data + moved, r);
+        moved += r;
+      }
+      break;
+    }
+
+    return moved;
+  }
+#endif
+
+  void write_or_queue(const uint8_t* data, size_t size) {
+    while (error_ == 0 && pending_.empty() && size > 0) {
+      const auto n = write_some(data, size);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          break;
+        }
+        fail(errno);
+        return;
+      }
+      data += n;
+      size -= n;
+    }
+
+    if (error_ == 0 && size > 0) {
+      pending_.insert(std::end(pending_), data, data + size);
+    }
+  }
+
+  // `write` which fails with EAGAIN instead of blocking.
+  ssize_t write_some(const uint8_t* data, size_t size) const {
+    if (is_socket_) {
+      int flags = MSG_DONTWAIT;
+#ifdef MSG_NOSIGNAL
+      flags |= MSG_NOSIGNAL;
+#endif
+      return send(target_, data, size, flags);
+    }
+
+    if (nonblocking_ || !may_block_) {
+      return write(target_, data, size);
+    }
+
+    // A blocking pipe or terminal. When POLLOUT is reported, a pipe accepts PIPE_BUF bytes without blocking.
+    pollfd p{target_, POLLOUT, 0};
+    const auto r = poll(&p, 1, 0);
+    if (r < 0) {
+      return r;
+    }
+    if (r == 0) {
+      errno = EAGAIN;
+      return -1;
+    }
+    if (!(p.revents & POLLOUT)) {
+      // POLLERR or POLLHUP. Let `write` report the error.
+      return write(target_, data, size);
+    }
+    return write(target_, data, std::min(size, size_t(PIPE_BUF)));
+  }
+
+  int target_;
+  int error_ = 0;
+  bool is_socket_ = false;
+  bool may_block_ = true;
+  bool nonblocking_ = false;
+  bool use_splice_ = false;
+  std::vector<uint8_t> pending_;
+  size_t pending_offset_ = 0;
+  int poll_file_descriptor_ = -1;
+  std::array<int, 2> tee_pipe_{
+      -1,
+      -1,
+  };
+};
+} // namespace pqrs::process
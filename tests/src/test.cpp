@@ -1,10 +1,17 @@
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <boost/ut.hpp>
 #include <chrono>
+#include <coroutine>
 #include <csignal>
+#include <fstream>
+#include <map>
 #include <pqrs/process.hpp>
 #include <pqrs/string.hpp>
 #include <pthread.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 #include <thread>
 
 namespace {
@@ -58,6 +65,61 @@ bool wait_until(F&& predicate,
   return predicate();
 }
 
+// A coroutine which starts immediately and is not awaited.
+struct detached_coroutine final {
+  struct promise_type final {
+    detached_coroutine get_return_object() noexcept {
+      return {};
+    }
+
+    std::suspend_never initial_suspend() noexcept {
+      return {};
+    }
+
+    std::suspend_never final_suspend() noexcept {
+      return {};
+    }
+
+    void return_void() noexcept {
+    }
+
+    void unhandled_exception() {
+      std::terminate();
+    }
+  };
+};
+
+detached_coroutine await_execute(std::weak_ptr<pqrs::dispatcher::dispatcher> weak_dispatcher,
+                                 std::vector<std::string> argv,
+                                 pqrs::process::execute_options options,
+                                 pqrs::process::executor resume_executor,
+                                 std::shared_ptr<pqrs::process::execute_result> result,
+                                 std::shared_ptr<pqrs::thread_wait> wait) {
+  *result = co_await pqrs::process::async_execute(weak_dispatcher,
+                                                  argv,
+                                                  std::move(options),
+                                                  std::move(resume_executor));
+  wait->notify();
+}
+
+detached_coroutine await_lines(std::shared_ptr<pqrs::process::process_reader> reader,
+                               std::shared_ptr<std::vector<std::string>> lines,
+                               std::shared_ptr<pqrs::thread_wait> wait) {
+  while (auto line = co_await reader->read_line()) {
+    lines->push_back(*line);
+  }
+  wait->notify();
+}
+
+detached_coroutine await_chunks(std::shared_ptr<pqrs::process::process_reader> reader,
+                                std::shared_ptr<std::string> output,
+                                std::shared_ptr<pqrs::thread_wait> wait) {
+  while (auto chunk = co_await reader->read_some()) {
+    *output += *chunk;
+  }
+  wait->notify();
+}
+
 } // namespace
 
 int main() {
@@ -165,6 +227,39 @@ int main() {
       expect(elapsed < 3000);
     }
 
+    // Destruction wakes up the polling loop immediately.
+
+    for (const auto& command : {"echo hello; sleep 30; echo world",
+                                "echo hello; exec /usr/bin/yes > /dev/null"}) {
+      const auto hello_wait = pqrs::make_thread_wait();
+      std::string stdout;
+      auto p = std::make_unique<pqrs::process::process>(dispatcher,
+                                                        std::vector<std::string>{
+                                                            "/bin/sh",
+                                                            "-c",
+                                                            command,
+                                                        });
+      p->stdout_received.connect([&stdout, hello_wait](auto&& buffer) {
+        for (const auto& c : *buffer) {
+          stdout += c;
+        }
+        if (stdout == "hello\n") {
+          hello_wait->notify();
+        }
+      });
+      p->run();
+
+      hello_wait->wait_notice();
+
+      auto start = std::chrono::steady_clock::now();
+      p = nullptr;
+      auto end = std::chrono::steady_clock::now();
+      auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+      std::cout << "destruction latency: " << elapsed << " us" << std::endl;
+
+      expect(elapsed < 5 * 1000);
+    }
+
     // Kill and wait automatically at destructor.
 
     {
@@ -331,6 +426,42 @@ int main() {
       local_dispatcher->terminate();
     }
 
+#ifdef __linux__
+    // `exited` is not delayed by descendants which inherited stdout and stderr (pidfd).
+
+    {
+      const auto wait = pqrs::make_thread_wait();
+      std::string stdout;
+      std::atomic<int> exit_code = -1;
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   "echo hello; sleep 10 & exit 3",
+                               });
+      p.stdout_received.connect([&stdout](auto&& buffer) {
+        for (const auto& c : *buffer) {
+          stdout += c;
+        }
+      });
+      p.exited.connect([&exit_code, wait](auto&& status) {
+        exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -2;
+        wait->notify();
+      });
+
+      auto start = std::chrono::system_clock::now();
+      p.run();
+      p.wait();
+      wait->wait_notice();
+      auto end = std::chrono::system_clock::now();
+      auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+      expect(elapsed < 3000);
+      expect(stdout == "hello\n");
+      expect(exit_code.load() == 3_i);
+    }
+#endif
+
     // SIGHUP will be ignored by program.
 
     {
@@ -509,32 +640,2010 @@ int main() {
     dispatcher = nullptr;
   };
 
-  "execute"_test = [] {
+  "reactor"_test = [] {
+    auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+    auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+    auto reactor = std::make_shared<pqrs::process::reactor>(2);
+
+    // Multiple processes share the reactor threads.
+
     {
-      pqrs::process::execute e(std::vector<std::string>{
-          "/bin/sh",
-          "-c",
-          "echo hello; echo error >&2; exit 3",
+      constexpr int count = 16;
+      std::vector<std::unique_ptr<pqrs::process::process>> processes;
+      std::vector<std::string> stdouts(count);
+      std::vector<std::string> stderrs(count);
+      std::vector<int> exit_codes(count, -1);
+
+      for (int i = 0; i < count; ++i) {
+        auto p = std::make_unique<pqrs::process::process>(dispatcher,
+                                                          std::vector<std::string>{
+                                                              "/bin/sh",
+                                                              "-c",
+                                                              "echo hello " + std::to_string(i) + "; echo error >&2; exit " + std::to_string(i),
+                                                          });
+        p->set_reactor(reactor);
+        p->stdout_received.connect([&stdouts, i](auto&& buffer) {
+          for (const auto& c : *buffer) {
+            stdouts[i] += c;
+          }
+        });
+        p->stderr_received.connect([&stderrs, i](auto&& buffer) {
+          for (const auto& c : *buffer) {
+            stderrs[i] += c;
+          }
+        });
+        p->exited.connect([&exit_codes, i](auto&& status) {
+          exit_codes[i] = WIFEXITED(status) ? WEXITSTATUS(status) : -2;
+        });
+        p->run();
+        processes.push_back(std::move(p));
+      }
+
+      for (auto&& p : processes) {
+        p->wait();
+      }
+
+      // Wait until the enqueued signals are processed.
+      const auto wait = pqrs::make_thread_wait();
+      processes.front()->enqueue_to_dispatcher([wait] {
+        wait->notify();
       });
-      expect(3 == e.get_exit_code());
-      expect("hello\n" == e.get_stdout());
-      expect("error\n" == e.get_stderr());
+      wait->wait_notice();
+
+      for (int i = 0; i < count; ++i) {
+        expect(stdouts[i] == "hello " + std::to_string(i) + "\n");
+        expect(stderrs[i] == "error\n");
+        expect(exit_codes[i] == i);
+      }
     }
 
+    // Kill and wait automatically at destructor.
+
     {
-      pqrs::process::execute e(std::vector<std::string>{
-          "/bin/sh",
-          "-c",
-          "kill -HUP $$",
-      });
-      expect(std::nullopt == e.get_exit_code());
+      auto p = std::make_unique<pqrs::process::process>(dispatcher,
+                                                        std::vector<std::string>{
+                                                            "/bin/sh",
+                                                            "-c",
+                                                            "echo hello; sleep 30; echo world",
+                                                        });
+      p->set_reactor(reactor);
+      p->run();
+      expect(static_cast<bool>(p->get_pid()));
+
+      auto start = std::chrono::system_clock::now();
+      p = nullptr;
+      auto end = std::chrono::system_clock::now();
+      auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+
+      expect(elapsed < 3000);
+    }
+
+    reactor = nullptr;
+
+    dispatcher->terminate();
+    dispatcher = nullptr;
+  };
+
+  "buffer_pool"_test = [] {
+    // Blocks are recycled.
+
+    {
+      pqrs::process::buffer_pool pool(1024, 4);
+      expect(pool.get_block_size() == 1024_ul);
+
+      const uint8_t* data = nullptr;
+      {
+        auto b = pool.acquire();
+        expect(b->capacity() == 1024_ul);
+        expect(b->empty());
+
+        b->get_writable_data()[0] = 'a';
+        b->set_size(1);
+        expect(b->size() == 1_ul);
+        expect(b->get_span()[0] == 'a');
+
+        data = b->data();
+      }
+
+      auto b = pool.acquire();
+      expect(b->data() == data);
+      expect(b->empty());
     }
 
+    // Buffers can outlive the pool.
+
     {
-      pqrs::process::execute e(std::vector<std::string>{});
-      expect(std::nullopt == e.get_exit_code());
-      expect("" == e.get_stdout());
-      expect("" == e.get_stderr());
+      std::shared_ptr<const pqrs::process::buffer> b;
+      {
+        pqrs::process::buffer_pool pool(16, 4);
+        auto writable = pool.acquire();
+        writable->get_writable_data()[0] = 'x';
+        writable->set_size(1);
+        b = std::move(writable);
+      }
+      expect(std::string(std::begin(*b), std::end(*b)) == "x");
+    }
+
+    // stdout_buffer_received
+
+    {
+      auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+      auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+      {
+        const auto wait = pqrs::make_thread_wait();
+        std::string stdout;
+        std::string stderr;
+        std::string legacy_stdout;
+        pqrs::process::process p(dispatcher,
+                                 std::vector<std::string>{
+                                     "/bin/sh",
+                                     "-c",
+                                     "echo hello; echo error >&2",
+                                 });
+        p.stdout_buffer_received.connect([&stdout](auto&& buffer) {
+          stdout.append(std::begin(*buffer), std::end(*buffer));
+        });
+        p.stderr_buffer_received.connect([&stderr](auto&& buffer) {
+          stderr.append(std::begin(*buffer), std::end(*buffer));
+        });
+        p.stdout_received.connect([&legacy_stdout](auto&& buffer) {
+          legacy_stdout.append(std::begin(*buffer), std::end(*buffer));
+        });
+        p.exited.connect([wait](auto&&) {
+          wait->notify();
+        });
+        p.run();
+        p.wait();
+        wait->wait_notice();
+
+        expect(stdout == "hello\n");
+        expect(stderr == "error\n");
+        expect(legacy_stdout == "hello\n");
+      }
+
+      dispatcher->terminate();
+      dispatcher = nullptr;
+    }
+  };
+
+  "line_framer"_test = [] {
+    pqrs::process::buffer_pool pool(64, 4);
+    auto make_chunk = [&pool](std::string_view s) {
+      auto b = pool.acquire();
+      std::copy(std::begin(s), std::end(s), b->get_writable_data());
+      b->set_size(s.size());
+      return std::shared_ptr<const pqrs::process::buffer>(std::move(b));
+    };
+    auto to_vector = [](auto&& batch) {
+      std::vector<std::string> lines;
+      if (batch) {
+        batch->for_each([&lines](auto&& line) {
+          lines.emplace_back(line);
+        });
+      }
+      return lines;
+    };
+
+    {
+      pqrs::process::line_framer framer;
+
+      expect(to_vector(framer.append(make_chunk("hel"))).empty());
+      expect(to_vector(framer.append(make_chunk("lo\nworld\n\nfoo"))) == std::vector<std::string>{"hello", "world", ""});
+      expect(to_vector(framer.append(make_chunk("bar\n"))) == std::vector<std::string>{"foobar"});
+      expect(to_vector(framer.append(make_chunk("baz"))).empty());
+      expect(to_vector(framer.flush()) == std::vector<std::string>{"baz"});
+      expect(!framer.flush());
+    }
+
+    {
+      pqrs::process::line_framer framer('\0');
+
+      expect(to_vector(framer.append(make_chunk(std::string_view("a\0b\0", 4)))) == std::vector<std::string>{"a", "b"});
+    }
+
+    // stdout_line_received
+
+    {
+      auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+      auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+      {
+        const auto wait = pqrs::make_thread_wait();
+        std::vector<std::string> stdout_lines;
+        std::vector<std::string> stderr_lines;
+        pqrs::process::process p(dispatcher,
+                                 std::vector<std::string>{
+                                     "/bin/sh",
+                                     "-c",
+                                     "printf 'hel'; sleep 0.1; printf 'lo\\nworld\\nlast'; echo error >&2",
+                                 });
+        p.enable_line_framing();
+        p.stdout_line_received.connect([&stdout_lines](auto&& line) {
+          stdout_lines.emplace_back(line);
+        });
+        p.stderr_line_received.connect([&stderr_lines](auto&& line) {
+          stderr_lines.emplace_back(line);
+        });
+        p.exited.connect([wait](auto&&) {
+          wait->notify();
+        });
+        p.run();
+        p.wait();
+        wait->wait_notice();
+
+        expect(stdout_lines == std::vector<std::string>{"hello", "world", "last"});
+        expect(stderr_lines == std::vector<std::string>{"error"});
+      }
+
+      dispatcher->terminate();
+      dispatcher = nullptr;
+    }
+  };
+
+  "frame_assembler"_test = [] {
+    {
+      pqrs::process::frame_assembler assembler("\n\n", pqrs::process::frame_delimiter_type::separator);
+
+      expect(std::nullopt == assembler.append("a\nb\n"));
+      expect("a\nb" == assembler.append("\nc"));
+      expect("c" == assembler.append("\n\n\n\n"));
+      expect("e" == assembler.append("d\n\ne\n\nf"));
+      expect(1_ul == assembler.get_dropped_count());
+      expect("f" == assembler.flush());
+      expect(std::nullopt == assembler.flush());
+    }
+
+    {
+      pqrs::process::frame_assembler assembler("Processes:", pqrs::process::frame_delimiter_type::header);
+
+      expect(std::nullopt == assembler.append("garbage\nProc"));
+      expect(std::nullopt == assembler.append("esses: 1\nline\n"));
+      expect("Processes: 1\nline\n" == assembler.append("Processes: 2\nx Processes: no\n"));
+      expect("Processes: 2\nx Processes: no\n" == assembler.append("Processes: 3\n"));
+      expect("Processes: 3\n" == assembler.flush());
+    }
+
+    {
+      pqrs::process::frame_assembler assembler("Processes:", pqrs::process::frame_delimiter_type::header);
+
+      expect(std::nullopt == assembler.append("no header\n"));
+      expect(std::nullopt == assembler.flush());
+    }
+
+    // stdout_frame_received
+
+    {
+      auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+      auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+      {
+        const auto wait = pqrs::make_thread_wait();
+        std::vector<int> frames;
+        pqrs::process::process p(dispatcher,
+                                 std::vector<std::string>{
+                                     "/bin/sh",
+                                     "-c",
+                                     "i=1; while [ $i -le 1000 ]; do printf 'frame\\n%d\\n\\n' $i; i=$((i+1)); done",
+                                 });
+        p.enable_frame_conflation("\n\n");
+        p.stdout_frame_received.connect([&frames](auto&& frame) {
+          frames.push_back(std::stoi(frame->substr(6)));
+          // A slow consumer
+          std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        });
+        p.exited.connect([wait](auto&&) {
+          wait->notify();
+        });
+
+        p.run();
+        wait->wait_notice();
+
+        expect(!frames.empty());
+        expect(1000 == frames.back());
+        expect(std::ranges::is_sorted(frames));
+        expect(std::ranges::adjacent_find(frames) == std::end(frames));
+        expect(frames.size() < 1000_ul);
+        expect(frames.size() + p.get_conflated_frame_count() == 1000_ul);
+      }
+
+      dispatcher->terminate();
+      dispatcher = nullptr;
+    }
+  };
+
+  "frame_differ"_test = [] {
+    using operation = pqrs::process::frame_delta::operation;
+
+    auto to_string = [](const pqrs::process::frame_delta& delta) {
+      std::string s;
+      for (const auto& c : delta.changes) {
+        switch (c.op) {
+          case operation::changed:
+            s += "~";
+            break;
+          case operation::added:
+            s += "+";
+            break;
+          case operation::removed:
+            s += "-";
+            break;
+        }
+        s += std::to_string(c.index) + ":" + std::string(c.line) + " ";
+      }
+      return s;
+    };
+
+    {
+      pqrs::process::frame_differ differ;
+
+      auto d = differ.diff(std::make_shared<std::string>("a\nb\nc\n"));
+      expect("+0:a +1:b +2:c " == to_string(d));
+      expect(3_ul == d.line_count);
+
+      d = differ.diff(std::make_shared<std::string>("a\nB\nc\nd"));
+      expect("~1:B +3:d " == to_string(d));
+      expect(4_ul == d.line_count);
+
+      d = differ.diff(std::make_shared<std::string>("a\nB\nc\nd"));
+      expect(d.changes.empty());
+
+      d = differ.diff(std::make_shared<std::string>("a\n\n"));
+      expect("~1: -2: -3: " == to_string(d));
+      expect(2_ul == d.line_count);
+    }
+
+    // Lines inserted into or removed from the middle
+
+    {
+      pqrs::process::frame_differ differ;
+
+      auto d = differ.diff(std::make_shared<std::string>("h\np1\np2\np3\np4\n"));
+      expect(5_ul == d.changes.size());
+
+      d = differ.diff(std::make_shared<std::string>("h\np1\nnew\np2\np3\np4\n"));
+      expect("+2:new " == to_string(d));
+      expect(6_ul == d.line_count);
+
+      d = differ.diff(std::make_shared<std::string>("h\np1\nnew\np3\np4\n"));
+      expect("-3: " == to_string(d));
+
+      // An inserted line and a changed line in the same frame
+      d = differ.diff(std::make_shared<std::string>("H\np0\np1\nnew\np3\np4\n"));
+      expect("~0:H +1:p0 " == to_string(d));
+
+      // Repeated lines are aligned around the unique ones.
+      d = differ.diff(std::make_shared<std::string>("-\n-\nH\n-\np0\np1\nnew\np3\np4\n"));
+      expect("+0:- +1:- +3:- " == to_string(d));
+    }
+
+    // stdout_frame_delta_received
+
+    {
+      auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+      auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+      {
+        const auto wait = pqrs::make_thread_wait();
+        std::vector<std::string> deltas;
+        pqrs::process::process p(dispatcher,
+                                 std::vector<std::string>{
+                                     "/bin/sh",
+                                     "-c",
+                                     "printf 'cpu 1\\nmem 2\\n--\\n'; sleep 0.1; printf 'cpu 3\\nmem 2\\n--\\n'; sleep 0.1; printf 'cpu 3\\nmem 2\\n--\\n'",
+                                 });
+        p.enable_frame_conflation("--\n");
+        p.enable_frame_deltas();
+        p.stdout_frame_delta_received.connect([&](auto&& delta) {
+          deltas.push_back(to_string(*delta));
+        });
+        p.exited.connect([wait](auto&&) {
+          wait->notify();
+        });
+
+        p.run();
+        wait->wait_notice();
+
+        expect(std::vector<std::string>{"+0:cpu 1 +1:mem 2 ", "~0:cpu 3 ", ""} == deltas);
+      }
+
+      dispatcher->terminate();
+      dispatcher = nullptr;
+    }
+  };
+
+  "stdin"_test = [] {
+    auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+    auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+    // Filter
+
+    {
+      const auto wait = pqrs::make_thread_wait();
+      std::string stdout;
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/usr/bin/sort",
+                               });
+      p.enable_stdin_pipe();
+      p.stdout_received.connect([&stdout](auto&& buffer) {
+        stdout.append(std::begin(*buffer), std::end(*buffer));
+      });
+      p.exited.connect([wait](auto&&) {
+        wait->notify();
+      });
+
+      expect(p.write_stdin("b\nc\n"));
+      p.run();
+      expect(p.write_stdin("a\n"));
+      p.close_stdin();
+      expect(!p.write_stdin("d\n"));
+
+      p.wait();
+      wait->wait_notice();
+
+      expect(stdout == "a\nb\nc\n");
+    }
+
+    // Large input is streamed with backpressure while stdout is drained.
+
+    {
+      const auto wait = pqrs::make_thread_wait();
+      constexpr size_t chunk_size = 64 * 1024;
+      constexpr int chunk_count = 64;
+      const auto chunk = std::make_shared<std::vector<uint8_t>>(chunk_size, 'x');
+      int written_count = 0;
+      size_t stdout_size = 0;
+      int rejected_count = 0;
+
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/cat",
+                               });
+      p.enable_stdin_pipe(4 * chunk_size);
+
+      auto feed = [&] {
+        while (written_count < chunk_count) {
+          if (!p.write_stdin(chunk)) {
+            ++rejected_count;
+            return;
+          }
+          ++written_count;
+        }
+        p.close_stdin();
+      };
+
+      p.stdin_drained.connect(feed);
+      p.stdout_received.connect([&stdout_size](auto&& buffer) {
+        stdout_size += buffer->size();
+      });
+      p.exited.connect([wait](auto&&) {
+        wait->notify();
+      });
+      p.run();
+      p.enqueue_to_dispatcher(feed);
+
+      p.wait();
+      wait->wait_notice();
+
+      expect(written_count == chunk_count);
+      expect(stdout_size == chunk_size * chunk_count);
+      expect(rejected_count > 0_i);
+    }
+
+    // The process closes stdin before reading all data.
+
+    {
+      const auto wait = pqrs::make_thread_wait();
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   "exec 0<&-; sleep 0.1",
+                               });
+      p.enable_stdin_pipe();
+      p.exited.connect([wait](auto&&) {
+        wait->notify();
+      });
+      p.run();
+      p.write_stdin(std::string(1024 * 1024, 'x'));
+
+      p.wait();
+      wait->wait_notice();
+    }
+
+    // The process closes stdin while nothing is queued and keeps running.
+    // The loop thread must not spin on POLLHUP of the write end.
+
+    {
+      const auto cpu_time = [] {
+        struct rusage usage {};
+        getrusage(RUSAGE_SELF, &usage);
+        return std::chrono::seconds(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+               std::chrono::microseconds(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+      };
+
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   "exec 0<&-; sleep 1",
+                               });
+      p.enable_stdin_pipe();
+
+      const auto start = cpu_time();
+      p.run();
+      p.wait();
+      const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(cpu_time() - start).count();
+
+      expect(elapsed < 300_l) << "cpu time:" << elapsed << "ms";
+      expect(!p.write_stdin("x"));
+    }
+
+    dispatcher->terminate();
+    dispatcher = nullptr;
+  };
+
+  "stats"_test = [] {
+    auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+    auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+    {
+      const auto wait = pqrs::make_thread_wait();
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   "printf hello; sleep 0.1; printf error >&2",
+                               });
+      p.enable_stats();
+      p.exited.connect([wait](auto&&) {
+        wait->notify();
+      });
+
+      expect(0_ul == p.get_stats()->read_count);
+
+      p.run();
+      p.wait();
+      wait->wait_notice();
+
+      const auto stats = p.get_stats();
+      expect(stats.has_value());
+      expect(stats->spawn_duration > std::chrono::nanoseconds(0));
+      expect(5_ul == stats->stdout_bytes);
+      expect(1_ul == stats->stdout_chunks);
+      expect(5_ul == stats->stderr_bytes);
+      expect(1_ul == stats->stderr_chunks);
+      expect(stats->read_count >= 2_ul);
+      expect(stats->poll_event_count >= 2_ul);
+      expect(stats->dispatcher_callback_count >= 3_ul);
+      expect(stats->max_dispatcher_lag >= stats->average_dispatcher_lag);
+      expect(stats->time_to_first_byte.has_value());
+      expect(*stats->time_to_first_byte < stats->wall_time);
+      expect(stats->wall_time >= std::chrono::milliseconds(100));
+
+      // wall_time stops at the exit.
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      expect(stats->wall_time == p.get_stats()->wall_time);
+    }
+
+    {
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/echo",
+                               });
+      expect(!p.get_stats());
+    }
+
+    dispatcher->terminate();
+    dispatcher = nullptr;
+  };
+
+  "io_tuning"_test = [] {
+    auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+    auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+#ifdef F_SETPIPE_SZ
+    {
+      pqrs::process::pipe p;
+      expect(p.set_capacity(256 * 1024));
+      expect(256 * 1024 == p.get_capacity());
+    }
+#endif
+
+    for (const auto max_blocks : {1, 4, 16}) {
+      const auto wait = pqrs::make_thread_wait();
+      std::string stdout;
+      size_t max_chunk_size = 0;
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   "seq 1 200000; sleep 0.1; echo done",
+                               });
+      p.set_pipe_size(256 * 1024);
+      p.enable_adaptive_read(max_blocks);
+      p.stdout_buffer_received.connect([&](auto&& buffer) {
+        stdout.append(std::begin(*buffer), std::end(*buffer));
+        max_chunk_size = std::max(max_chunk_size, buffer->size());
+      });
+      p.exited.connect([wait](auto&&) {
+        wait->notify();
+      });
+
+      p.run();
+      wait->wait_notice();
+
+      std::string expected;
+      for (int i = 1; i <= 200000; ++i) {
+        expected += std::to_string(i) + "\n";
+      }
+      expected += "done\n";
+      expect(expected == stdout);
+      expect(max_chunk_size <= 32 * 1024);
+    }
+
+    // Adaptive reads need fewer `read` calls for the same output.
+
+    {
+      auto read_count = [&](bool adaptive) {
+        pqrs::process::process p(dispatcher,
+                                 std::vector<std::string>{
+                                     "/bin/sh",
+                                     "-c",
+                                     "head -c 16000000 /dev/zero",
+                                 });
+        p.set_pipe_size(1024 * 1024);
+        if (adaptive) {
+          p.enable_adaptive_read(16);
+        }
+        p.enable_stats();
+        p.run();
+        p.wait();
+
+        const auto stats = p.get_stats();
+        expect(16000000_ul == stats->stdout_bytes);
+        return stats->read_count;
+      };
+
+      const auto plain = read_count(false);
+      const auto adaptive = read_count(true);
+      expect(adaptive * 2 < plain) << "read_count:" << adaptive << "(adaptive)" << plain << "(plain)";
+    }
+
+    dispatcher->terminate();
+    dispatcher = nullptr;
+  };
+
+  "backpressure"_test = [] {
+    auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+    auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+    {
+      constexpr size_t max_bytes = 256 * 1024;
+      std::mutex mutex;
+      std::vector<std::shared_ptr<const pqrs::process::buffer>> held;
+      size_t received = 0;
+      size_t capacity = 0;
+
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/usr/bin/yes",
+                               });
+      p.set_max_in_flight_bytes(max_bytes);
+      p.stdout_buffer_received.connect([&](auto&& buffer) {
+        std::lock_guard<std::mutex> lock(mutex);
+        held.push_back(buffer);
+        received += buffer->size();
+        capacity += buffer->capacity();
+      });
+
+      expect(0_ul == p.get_in_flight_bytes());
+      expect(0_ul == p.get_queue_depth());
+
+      p.run();
+
+      // The reader stops at the limit while the consumer holds the chunks.
+      expect(wait_until([&] {
+        return p.get_in_flight_bytes() >= max_bytes;
+      }));
+      std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        expect(p.get_in_flight_bytes() < max_bytes + 64 * 1024);
+        expect(p.get_in_flight_bytes() == capacity);
+        expect(p.get_queue_depth() == held.size());
+
+        // Release the chunks.
+        received = 0;
+        capacity = 0;
+        held.clear();
+      }
+
+      // Reading resumes.
+      expect(wait_until([&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        return received >= max_bytes;
+      }));
+
+      p.kill(SIGKILL);
+      p.wait();
+    }
+
+    // Small chunks are counted by the memory they hold.
+
+    {
+      constexpr size_t max_bytes = 64 * 1024;
+      std::mutex mutex;
+      std::vector<std::shared_ptr<const pqrs::process::buffer>> held;
+
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   "while :; do echo x; done",
+                               });
+      p.set_max_in_flight_bytes(max_bytes);
+      p.stdout_buffer_received.connect([&](auto&& buffer) {
+        std::lock_guard<std::mutex> lock(mutex);
+        held.push_back(buffer);
+      });
+
+      p.run();
+
+      expect(wait_until([&] {
+        return p.get_in_flight_bytes() >= max_bytes;
+      }));
+      std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        expect(held.size() <= 3_ul) << "queue depth:" << held.size();
+        expect(p.get_queue_depth() == held.size());
+        expect(p.get_in_flight_bytes() == held.size() * held.front()->capacity());
+
+        held.clear();
+      }
+
+      p.kill(SIGKILL);
+      p.wait();
+    }
+
+    // The chunks are released after the process is destroyed.
+
+    for (int i = 0; i < 20; ++i) {
+      std::mutex mutex;
+      std::vector<std::shared_ptr<const pqrs::process::buffer>> held;
+
+      {
+        pqrs::process::process p(dispatcher,
+                                 std::vector<std::string>{
+                                     "/usr/bin/yes",
+                                 });
+        p.set_max_in_flight_bytes(64 * 1024);
+        p.stdout_buffer_received.connect([&](auto&& buffer) {
+          std::lock_guard<std::mutex> lock(mutex);
+          held.push_back(buffer);
+        });
+        p.run();
+
+        if (i % 2 == 0) {
+          wait_until([&] {
+            return p.get_in_flight_bytes() >= 64 * 1024;
+          });
+        }
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      held.clear();
+    }
+
+    dispatcher->terminate();
+    dispatcher = nullptr;
+  };
+
+  "coalescing"_test = [] {
+    auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+    auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+    struct result final {
+      std::string stdout;
+      std::vector<size_t> chunk_sizes;
+    };
+
+    const auto run = [&](const std::string& command, size_t threshold, std::chrono::milliseconds max_delay) {
+      const auto wait = pqrs::make_thread_wait();
+      result r;
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   command,
+                               });
+      p.enable_coalescing(threshold, max_delay);
+      p.stdout_buffer_received.connect([&](auto&& buffer) {
+        r.stdout.append(std::begin(*buffer), std::end(*buffer));
+        r.chunk_sizes.push_back(buffer->size());
+      });
+      p.exited.connect([wait](auto&&) {
+        wait->notify();
+      });
+      p.run();
+      wait->wait_notice();
+      return r;
+    };
+
+    // Tiny fragments
+
+    {
+      auto r = run("i=0; while [ $i -lt 200 ]; do printf x; i=$((i+1)); done",
+                   16 * 1024,
+                   std::chrono::milliseconds(1000));
+      expect(std::string(200, 'x') == r.stdout);
+      expect(1_ul == r.chunk_sizes.size());
+    }
+
+    // Size threshold
+
+    {
+      auto r = run("i=0; while [ $i -lt 300 ]; do printf 0123456789; i=$((i+1)); done",
+                   1000,
+                   std::chrono::milliseconds(1000));
+      expect(3000_ul == r.stdout.size());
+      // Only the last chunk, which is flushed at the end of the stream, can be smaller than the threshold.
+      for (size_t i = 0; i + 1 < r.chunk_sizes.size(); ++i) {
+        expect(r.chunk_sizes[i] >= 1000_ul);
+      }
+      expect(r.chunk_sizes.size() <= 4_ul);
+    }
+
+    // Large chunks are delivered as is.
+
+    {
+      auto r = run("head -c 100000 /dev/zero",
+                   100,
+                   std::chrono::milliseconds(1000));
+      expect(100000_ul == r.stdout.size());
+      for (const auto& size : r.chunk_sizes) {
+        expect(size >= 100_ul);
+      }
+    }
+
+    // Max delay
+
+    {
+      std::vector<std::chrono::steady_clock::time_point> times;
+      const auto wait = pqrs::make_thread_wait();
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   "printf a; sleep 0.5; printf b",
+                               });
+      p.enable_coalescing(16 * 1024, std::chrono::milliseconds(10));
+      p.stdout_buffer_received.connect([&](auto&&) {
+        times.push_back(std::chrono::steady_clock::now());
+      });
+      p.exited.connect([&, wait](auto&&) {
+        times.push_back(std::chrono::steady_clock::now());
+        wait->notify();
+      });
+      p.run();
+      wait->wait_notice();
+
+      expect(3_ul == times.size());
+      if (times.size() == 3) {
+        expect(times[2] - times[0] >= std::chrono::milliseconds(400));
+      }
+    }
+
+    dispatcher->terminate();
+    dispatcher = nullptr;
+  };
+
+  "inline_delivery"_test = [] {
+    auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+    auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+    for (const auto use_reactor : {false, true}) {
+      const auto main_thread_id = std::this_thread::get_id();
+      std::atomic<bool> on_other_thread = true;
+      size_t stdout_size = 0;
+      std::string stderr;
+      std::optional<int> inline_status;
+      std::atomic<int> dispatcher_chunks = 0;
+      const auto wait = pqrs::make_thread_wait();
+      int status = 0;
+
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   "head -c 100000 /dev/zero; printf error >&2; exit 3",
+                               });
+      if (use_reactor) {
+        p.set_reactor(std::make_shared<pqrs::process::reactor>(1));
+      }
+      p.enable_inline_delivery({
+          .stdout_received = [&](auto&& data) {
+            if (std::this_thread::get_id() == main_thread_id) {
+              on_other_thread = false;
+            }
+            stdout_size += data.size();
+          },
+          .stderr_received = [&](auto&& data) {
+            stderr.append(std::begin(data), std::end(data));
+          },
+          .exited = [&](auto&& s) {
+            inline_status = s;
+          },
+      });
+      p.stdout_buffer_received.connect([&](auto&&) {
+        ++dispatcher_chunks;
+      });
+      p.exited.connect([&, wait](auto&& s) {
+        status = s;
+        wait->notify();
+      });
+
+      p.run();
+      p.wait();
+
+      // The handlers have been called when `wait` returns.
+      expect(100000_ul == stdout_size);
+      expect("error" == stderr);
+      expect(inline_status.has_value());
+      expect(on_other_thread.load());
+
+      wait->wait_notice();
+      expect(*inline_status == status);
+      expect(3 == WEXITSTATUS(status));
+      expect(0 == dispatcher_chunks);
+    }
+
+    dispatcher->terminate();
+    dispatcher = nullptr;
+  };
+
+  "deadline"_test = [] {
+    auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+    auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+    // SIGTERM
+
+    {
+      const auto wait = pqrs::make_thread_wait();
+      std::string stdout;
+      int status = 0;
+      bool timed_out = false;
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   "echo partial; exec sleep 10",
+                               });
+      p.set_deadline(std::chrono::milliseconds(100));
+      p.stdout_received.connect([&](auto&& buffer) {
+        stdout.append(std::begin(*buffer), std::end(*buffer));
+      });
+      p.timed_out.connect([&] {
+        timed_out = true;
+      });
+      p.exited.connect([&, wait](auto&& s) {
+        status = s;
+        wait->notify();
+      });
+
+      const auto start = std::chrono::steady_clock::now();
+      p.run();
+      wait->wait_notice();
+      const auto elapsed = std::chrono::steady_clock::now() - start;
+
+      expect(timed_out);
+      expect(p.get_timed_out());
+      expect(WIFSIGNALED(status));
+      expect(SIGTERM == WTERMSIG(status));
+      expect("partial\n" == stdout);
+      // The dispatcher clock has millisecond resolution.
+      expect(elapsed >= std::chrono::milliseconds(99));
+      expect(elapsed < std::chrono::seconds(5));
+    }
+
+    // Escalation to SIGKILL
+
+    {
+      const auto wait = pqrs::make_thread_wait();
+      int status = 0;
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   "trap '' TERM; exec sleep 10",
+                               });
+      p.set_deadline(std::chrono::milliseconds(100),
+                     SIGTERM,
+                     std::chrono::milliseconds(200));
+      p.exited.connect([&, wait](auto&& s) {
+        status = s;
+        wait->notify();
+      });
+
+      const auto start = std::chrono::steady_clock::now();
+      p.run();
+      wait->wait_notice();
+      const auto elapsed = std::chrono::steady_clock::now() - start;
+
+      expect(p.get_timed_out());
+      expect(WIFSIGNALED(status));
+      expect(SIGKILL == WTERMSIG(status));
+      expect(elapsed >= std::chrono::milliseconds(300));
+      expect(elapsed < std::chrono::seconds(5));
+    }
+
+    // The process exits before the deadline.
+
+    {
+      const auto wait = pqrs::make_thread_wait();
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/echo",
+                               });
+      p.set_deadline(std::chrono::milliseconds(100));
+      p.exited.connect([wait](auto&&) {
+        wait->notify();
+      });
+
+      p.run();
+      wait->wait_notice();
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+      expect(!p.get_timed_out());
+    }
+
+    // execute
+
+    {
+      pqrs::process::execute_options options;
+      options.deadline = std::chrono::milliseconds(100);
+      pqrs::process::execute e(std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   "echo partial; echo error >&2; exec sleep 10",
+                               },
+                               options);
+      expect(e.get_timed_out());
+      expect(std::nullopt == e.get_exit_code());
+      expect("partial\n" == e.get_stdout());
+      expect("error\n" == e.get_stderr());
+    }
+
+    {
+      pqrs::process::execute_options options;
+      options.deadline = std::chrono::seconds(10);
+      pqrs::process::execute e(std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   "exit 2",
+                               },
+                               options);
+      expect(!e.get_timed_out());
+      expect(2 == e.get_exit_code());
+    }
+
+    // A zero timeout is not lost even if it expires right after spawning.
+
+    {
+      pqrs::process::execute_options options;
+      options.deadline = std::chrono::milliseconds(0);
+
+      int timed_out_count = 0;
+      for (int i = 0; i < 200; ++i) {
+        pqrs::process::execute e(std::vector<std::string>{
+                                     "/bin/sleep",
+                                     "10",
+                                 },
+                                 options);
+        if (e.get_timed_out() && std::nullopt == e.get_exit_code()) {
+          ++timed_out_count;
+        }
+      }
+      expect(200_i == timed_out_count);
+    }
+
+    dispatcher->terminate();
+    dispatcher = nullptr;
+  };
+
+  "command_spec"_test = [] {
+    {
+      pqrs::process::command_spec spec(std::vector<std::string>{"/bin/echo", "", "hello"});
+      expect(!spec.empty());
+      expect(3_ul == spec.get_argc());
+      expect(std::string_view("/bin/echo") == spec.get_argv()[0]);
+      expect(std::string_view("") == spec.get_argv()[1]);
+      expect(std::string_view("hello") == spec.get_argv()[2]);
+      expect(nullptr == spec.get_argv()[3]);
+      expect(nullptr == spec.get_envp());
+    }
+
+    {
+      pqrs::process::command_spec spec(std::vector<std::string>{}, std::vector<std::string>{"A=1"});
+      expect(spec.empty());
+      expect(nullptr == spec.get_argv()[0]);
+      expect(std::string_view("A=1") == spec.get_envp()[0]);
+      expect(nullptr == spec.get_envp()[1]);
+    }
+
+    // A spec is shared by processes.
+
+    {
+      auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+      auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+      const auto spec = std::make_shared<pqrs::process::command_spec>(
+          std::vector<std::string>{"/usr/bin/env"},
+          std::vector<std::string>{"FOO=bar", "BAZ=qux"});
+
+      for (int i = 0; i < 3; ++i) {
+        const auto wait = pqrs::make_thread_wait();
+        std::string stdout;
+        pqrs::process::process p(dispatcher, spec);
+        p.stdout_received.connect([&stdout](auto&& buffer) {
+          stdout.append(std::begin(*buffer), std::end(*buffer));
+        });
+        p.exited.connect([wait](auto&&) {
+          wait->notify();
+        });
+        p.run();
+
+        p.wait();
+        wait->wait_notice();
+
+        expect("FOO=bar\nBAZ=qux\n" == stdout);
+      }
+
+      dispatcher->terminate();
+      dispatcher = nullptr;
+    }
+  };
+
+  "close_on_exec"_test = [] {
+    auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+    auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+    // A pipe receives EOF as soon as its write end is closed, even while other threads spawn processes.
+
+    {
+      auto reactor = std::make_shared<pqrs::process::reactor>(1);
+      std::atomic<bool> stop = false;
+      std::thread spawner([&] {
+        // Keep the children alive until the end of the test, so that an inherited write end would delay EOF.
+        std::vector<std::unique_ptr<pqrs::process::process>> processes;
+        while (!stop) {
+          auto p = std::make_unique<pqrs::process::process>(dispatcher,
+                                                            std::vector<std::string>{
+                                                                "/bin/sleep",
+                                                                "3",
+                                                            });
+          p->set_reactor(reactor);
+          p->run();
+          processes.push_back(std::move(p));
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+      });
+
+      size_t late_eof_count = 0;
+      for (int i = 0; i < 200; ++i) {
+        pqrs::process::pipe p;
+        // The other thread spawns processes while the write end is open.
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        p.close_write_end();
+
+        pollfd fds{*p.get_read_end(), POLLIN, 0};
+        char c;
+        if (poll(&fds, 1, 200) != 1 || read(*p.get_read_end(), &c, 1) != 0) {
+          ++late_eof_count;
+        }
+      }
+
+      stop = true;
+      spawner.join();
+
+      expect(0_ul == late_eof_count);
+    }
+
+#ifdef __linux__
+    // enable_close_other_file_descriptors
+
+    for (const auto close_others : {false, true}) {
+      // A descriptor which is not close-on-exec.
+      int fds[2];
+      expect(0 == ::pipe(fds));
+
+      const auto wait = pqrs::make_thread_wait();
+      std::string stdout;
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   "ls /proc/self/fd",
+                               });
+      if (close_others) {
+        p.enable_close_other_file_descriptors();
+      }
+      p.stdout_received.connect([&](auto&& buffer) {
+        stdout.append(std::begin(*buffer), std::end(*buffer));
+      });
+      p.exited.connect([wait](auto&&) {
+        wait->notify();
+      });
+      p.run();
+      wait->wait_notice();
+
+      // `ls` opens /proc/self/fd as 3.
+      const auto inherited = stdout.find("\n" + std::to_string(fds[1]) + "\n") != std::string::npos;
+      expect(close_others != inherited);
+      if (close_others) {
+        expect("0\n1\n2\n3\n" == stdout);
+      }
+
+      close(fds[0]);
+      close(fds[1]);
+    }
+#endif
+
+    dispatcher->terminate();
+    dispatcher = nullptr;
+  };
+
+  "redirect"_test = [] {
+    auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+    auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+    auto make_temporary_file = [] {
+      std::string path = "/tmp/pqrs-process-test-XXXXXX";
+      close(mkstemp(path.data()));
+      return path;
+    };
+
+    auto read_file = [](const std::string& path) {
+      std::ifstream stream(path, std::ios::binary);
+      return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    };
+
+    // redirect_stdout, redirect_stderr
+
+    {
+      const auto stdout_path = make_temporary_file();
+      const auto stderr_path = make_temporary_file();
+      const auto stderr_fd = open(stderr_path.c_str(), O_WRONLY);
+
+      const auto wait = pqrs::make_thread_wait();
+      size_t received_size = 0;
+      int exit_status = 0;
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   "echo hello; echo error >&2; exit 3",
+                               });
+      p.redirect_stdout(stdout_path);
+      p.redirect_stderr(stderr_fd);
+      p.stdout_received.connect([&received_size](auto&& buffer) {
+        received_size += buffer->size();
+      });
+      p.exited.connect([wait, &exit_status](auto&& status) {
+        exit_status = status;
+        wait->notify();
+      });
+      p.run();
+      close(stderr_fd);
+
+      p.wait();
+      wait->wait_notice();
+
+      expect(WIFEXITED(exit_status));
+      expect(3_i == WEXITSTATUS(exit_status));
+      expect(0_ul == received_size);
+      expect("hello\n" == read_file(stdout_path));
+      expect("error\n" == read_file(stderr_path));
+
+      unlink(stdout_path.c_str());
+      unlink(stderr_path.c_str());
+    }
+
+    // forward_stdout
+    // O_APPEND is not supported by `splice` on some kernels, so it tests the fallback on Linux.
+
+    for (const auto flags : {O_WRONLY, O_WRONLY | O_APPEND}) {
+      const auto path = make_temporary_file();
+      const auto fd = open(path.c_str(), flags);
+
+      const auto wait = pqrs::make_thread_wait();
+      std::string received;
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   "head -c 1000000 /dev/zero | tr '\\0' x; echo hello",
+                               });
+      p.forward_stdout(fd);
+      p.stdout_received.connect([&received](auto&& buffer) {
+        received.append(std::begin(*buffer), std::end(*buffer));
+      });
+      p.exited.connect([wait](auto&&) {
+        wait->notify();
+      });
+      p.run();
+
+      p.wait();
+      wait->wait_notice();
+      close(fd);
+
+      expect(1000006_ul == received.size());
+      expect(received == read_file(path));
+
+      unlink(path.c_str());
+    }
+
+    // Writing to the target fails.
+
+    {
+      auto target = std::make_unique<pqrs::process::pipe>();
+      target->close_read_end();
+
+      const auto wait = pqrs::make_thread_wait();
+      std::string received;
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/echo",
+                                   "hello",
+                               });
+      p.forward_stdout(*(target->get_write_end()));
+      p.stdout_received.connect([&received](auto&& buffer) {
+        received.append(std::begin(*buffer), std::end(*buffer));
+      });
+      p.exited.connect([wait](auto&&) {
+        wait->notify();
+      });
+      p.run();
+
+      p.wait();
+      wait->wait_notice();
+
+      expect("hello\n" == received);
+    }
+
+    // The target is a blocking pipe which is read slowly.
+    // All data is forwarded before `exited` without blocking the polling thread.
+
+    {
+      auto target = std::make_unique<pqrs::process::pipe>();
+      std::string forwarded;
+      std::thread reader([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        std::array<char, 4096> data;
+        while (true) {
+          const auto n = read(*(target->get_read_end()), data.data(), data.size());
+          if (n <= 0) {
+            break;
+          }
+          forwarded.append(data.data(), n);
+          std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+      });
+
+      const auto wait = pqrs::make_thread_wait();
+      size_t received = 0;
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   "head -c 1000000 /dev/zero | tr '\\0' x",
+                               });
+      p.forward_stdout(*(target->get_write_end()));
+      p.stdout_received.connect([&received](auto&& buffer) {
+        received += buffer->size();
+      });
+      p.exited.connect([wait](auto&&) {
+        wait->notify();
+      });
+      p.run();
+
+      p.wait();
+      wait->wait_notice();
+
+      target->close_write_end();
+      reader.join();
+
+      expect(1000000_ul == received);
+      expect(1000000_ul == forwarded.size());
+    }
+
+    // The target is a socket which nobody reads.
+    // The process is destroyed without waiting for the target.
+
+    {
+      std::array<int, 2> sockets;
+      expect(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, sockets.data()));
+
+      const auto start = std::chrono::steady_clock::now();
+      {
+        pqrs::process::process p(dispatcher,
+                                 std::vector<std::string>{
+                                     "/usr/bin/yes",
+                                 });
+        p.forward_stdout(sockets[0]);
+        p.run();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      }
+      const auto elapsed = std::chrono::steady_clock::now() - start;
+
+      expect(elapsed < std::chrono::seconds(2));
+
+      close(sockets[0]);
+      close(sockets[1]);
+    }
+
+    dispatcher->terminate();
+    dispatcher = nullptr;
+  };
+
+  "pipeline"_test = [] {
+    auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+    auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+    {
+      const auto wait = pqrs::make_thread_wait();
+      std::string stdout;
+      std::vector<std::pair<size_t, int>> stage_statuses;
+      int exit_status = -1;
+
+      pqrs::process::pipeline p(dispatcher,
+                                std::vector<std::vector<std::string>>{
+                                    {"/bin/sh", "-c", "printf 'b\\na\\nc\\n'; exit 2"},
+                                    {"/usr/bin/sort"},
+                                    {"/usr/bin/tr", "a-z", "A-Z"},
+                                });
+      p.stdout_received.connect([&stdout](auto&& buffer) {
+        stdout.append(std::begin(*buffer), std::end(*buffer));
+      });
+      p.stage_exited.connect([&stage_statuses](auto&& index, auto&& status) {
+        stage_statuses.emplace_back(index, status);
+      });
+      p.exited.connect([wait, &exit_status](auto&& status) {
+        exit_status = status;
+        wait->notify();
+      });
+      p.run();
+
+      p.wait();
+      wait->wait_notice();
+
+      expect("A\nB\nC\n" == stdout);
+      expect(3_ul == stage_statuses.size());
+      for (const auto& [index, status] : stage_statuses) {
+        expect(WIFEXITED(status));
+        expect((index == 0 ? 2 : 0) == WEXITSTATUS(status));
+      }
+      expect(WIFEXITED(exit_status));
+      expect(0_i == WEXITSTATUS(exit_status));
+    }
+
+    // enable_stage_stderr
+
+    {
+      const auto wait = pqrs::make_thread_wait();
+      std::string stdout;
+      std::string stderr;
+      std::map<size_t, std::string> stage_stderr;
+
+      pqrs::process::pipeline p(dispatcher,
+                                std::vector<std::vector<std::string>>{
+                                    {"/bin/sh", "-c", "echo error0 >&2; echo hello"},
+                                    {"/bin/sh", "-c", "cat; echo error1 >&2"},
+                                });
+      p.enable_stage_stderr();
+      p.stdout_received.connect([&stdout](auto&& buffer) {
+        stdout.append(std::begin(*buffer), std::end(*buffer));
+      });
+      p.stderr_received.connect([&stderr](auto&& buffer) {
+        stderr.append(std::begin(*buffer), std::end(*buffer));
+      });
+      p.stage_stderr_received.connect([&stage_stderr](auto&& index, auto&& buffer) {
+        stage_stderr[index].append(std::begin(*buffer), std::end(*buffer));
+      });
+      p.exited.connect([wait](auto&&) {
+        wait->notify();
+      });
+      p.run();
+
+      p.wait();
+      wait->wait_notice();
+
+      expect("hello\n" == stdout);
+      expect("error1\n" == stderr);
+      expect("error0\n" == stage_stderr[0]);
+      expect("error1\n" == stage_stderr[1]);
+    }
+
+    // The first stage receives SIGPIPE when the next stage exits.
+
+    {
+      const auto wait = pqrs::make_thread_wait();
+      std::string stdout;
+      int first_status = 0;
+
+      pqrs::process::pipeline p(dispatcher,
+                                std::vector<std::vector<std::string>>{
+                                    {"/usr/bin/yes"},
+                                    {"/usr/bin/head", "-n", "2"},
+                                    {"/bin/cat"},
+                                });
+      p.stdout_received.connect([&stdout](auto&& buffer) {
+        stdout.append(std::begin(*buffer), std::end(*buffer));
+      });
+      p.stage_exited.connect([&first_status](auto&& index, auto&& status) {
+        if (index == 0) {
+          first_status = status;
+        }
+      });
+      p.exited.connect([wait](auto&&) {
+        wait->notify();
+      });
+      p.run();
+
+      p.wait();
+      wait->wait_notice();
+
+      expect("y\ny\n" == stdout);
+      expect(WIFSIGNALED(first_status));
+      expect(SIGPIPE == WTERMSIG(first_status));
+    }
+
+    // A stage fails to run.
+
+    {
+      const auto wait = pqrs::make_thread_wait();
+      bool exited = false;
+
+      pqrs::process::pipeline p(dispatcher,
+                                std::vector<std::vector<std::string>>{
+                                    {"/bin/cat"},
+                                    {},
+                                });
+      p.run_failed.connect([wait] {
+        wait->notify();
+      });
+      p.exited.connect([&exited](auto&&) {
+        exited = true;
+      });
+      p.run();
+
+      p.wait();
+      wait->wait_notice();
+
+      expect(!exited);
+    }
+
+    dispatcher->terminate();
+    dispatcher = nullptr;
+  };
+
+  "execute"_test = [] {
+    {
+      pqrs::process::execute e(std::vector<std::string>{
+          "/bin/sh",
+          "-c",
+          "echo hello; echo error >&2; exit 3",
+      });
+      expect(3 == e.get_exit_code());
+      expect("hello\n" == e.get_stdout());
+      expect("error\n" == e.get_stderr());
+    }
+
+    {
+      pqrs::process::execute e(std::vector<std::string>{
+          "/bin/sh",
+          "-c",
+          "kill -HUP $$",
+      });
+      expect(std::nullopt == e.get_exit_code());
+    }
+
+    {
+      pqrs::process::execute e(std::vector<std::string>{});
+      expect(std::nullopt == e.get_exit_code());
+      expect("" == e.get_stdout());
+      expect("" == e.get_stderr());
+    }
+
+    // resource_usage
+
+    {
+      pqrs::process::execute e(std::vector<std::string>{
+          "/bin/sh",
+          "-c",
+          "i=0; while [ $i -lt 100000 ]; do i=$((i+1)); done",
+      });
+      expect(0 == e.get_exit_code());
+      expect(e.get_resource_usage().has_value());
+      expect(e.get_resource_usage()->user_time + e.get_resource_usage()->system_time > std::chrono::microseconds(0));
+      expect(e.get_resource_usage()->max_rss_bytes > 1024 * 1024);
+    }
+
+    {
+      pqrs::process::execute e(std::vector<std::string>{});
+      expect(!e.get_resource_usage());
+    }
+
+    // fast_spawn
+
+    {
+      pqrs::process::execute e(std::vector<std::string>{
+                                   "/bin/echo",
+                                   "hello",
+                               },
+                               pqrs::process::execute_options{
+                                   .fast_spawn = true,
+                               });
+      expect(0 == e.get_exit_code());
+      expect("hello\n" == e.get_stdout());
+    }
+
+    // take_stdout
+
+    {
+      pqrs::process::execute e(std::vector<std::string>{
+          "/bin/echo",
+          "hello",
+      });
+      expect("hello\n" == e.take_stdout());
+      expect("" == e.get_stdout());
+    }
+
+    // output_sink
+
+    {
+      pqrs::process::execute_options options;
+      options.stdout_sink = pqrs::process::output_sink::head_and_tail(4, 3);
+      options.stderr_sink = pqrs::process::output_sink::discard();
+
+      pqrs::process::execute e(std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   "printf 0123; sleep 0.1; printf 456789abcdef; echo error >&2",
+                               },
+                               std::move(options));
+      expect("0123def" == e.get_stdout());
+      expect(16_ul == e.get_stdout_sink().get_total_size());
+      expect(9_ul == e.get_stdout_sink().get_omitted_size());
+      expect("" == e.get_stderr());
+      expect(6_ul == e.get_stderr_sink().get_total_size());
+    }
+
+    {
+      auto p = std::make_unique<pqrs::process::pipe>();
+
+      pqrs::process::execute_options options;
+      options.stdout_sink = pqrs::process::output_sink::file_descriptor(*(p->get_write_end()));
+
+      pqrs::process::execute e(std::vector<std::string>{
+                                   "/bin/echo",
+                                   "hello",
+                               },
+                               std::move(options));
+      p->close_write_end();
+
+      std::string actual(64, '\0');
+      actual.resize(read(*(p->get_read_end()), actual.data(), actual.size()));
+
+      expect("hello\n" == actual);
+      expect("" == e.get_stdout());
+      expect(0_i == e.get_stdout_sink().get_error());
+    }
+
+    {
+      auto sink = pqrs::process::output_sink::head_and_tail(2, 4);
+      for (const auto& s : {"ab", "cdefgh", "ij", "k"}) {
+        sink.write(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(s), strlen(s)));
+      }
+      expect(5_ul == sink.get_omitted_size());
+      expect("abhijk" == sink.take());
+    }
+  };
+
+  "async_execute"_test = [] {
+    auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+    auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+    {
+      auto result = std::make_shared<pqrs::process::execute_result>();
+      const auto wait = pqrs::make_thread_wait();
+      await_execute(dispatcher,
+                    {"/bin/sh", "-c", "echo hello; echo error >&2; exit 3"},
+                    {},
+                    nullptr,
+                    result,
+                    wait);
+      wait->wait_notice();
+
+      expect(3 == result->get_exit_code());
+      expect("hello\n" == result->get_stdout());
+      expect("error\n" == result->get_stderr());
+      expect(!result->get_run_failed());
+      expect(result->get_resource_usage().has_value());
+    }
+
+    // run_failed
+
+    {
+      auto result = std::make_shared<pqrs::process::execute_result>();
+      const auto wait = pqrs::make_thread_wait();
+      await_execute(dispatcher, {}, {}, nullptr, result, wait);
+      wait->wait_notice();
+
+      expect(result->get_run_failed());
+      expect(std::nullopt == result->get_exit_code());
+    }
+
+    // Many commands on a reactor
+
+    {
+      constexpr size_t count = 32;
+      pqrs::process::execute_options options;
+      options.reactor = std::make_shared<pqrs::process::reactor>(1);
+
+      std::vector<std::shared_ptr<pqrs::process::execute_result>> results;
+      std::vector<std::shared_ptr<pqrs::thread_wait>> waits;
+      for (size_t i = 0; i < count; ++i) {
+        results.push_back(std::make_shared<pqrs::process::execute_result>());
+        waits.push_back(pqrs::make_thread_wait());
+        await_execute(dispatcher,
+                      {"/bin/sh", "-c", "sleep 0.1; echo " + std::to_string(i)},
+                      options,
+                      nullptr,
+                      results.back(),
+                      waits.back());
+      }
+
+      for (size_t i = 0; i < count; ++i) {
+        waits[i]->wait_notice();
+        expect(0 == results[i]->get_exit_code());
+        expect(std::to_string(i) + "\n" == results[i]->get_stdout());
+      }
+    }
+
+    // resume_executor
+
+    {
+      std::atomic<int> resumed = 0;
+      auto result = std::make_shared<pqrs::process::execute_result>();
+      const auto wait = pqrs::make_thread_wait();
+      await_execute(
+          dispatcher,
+          {"/bin/echo", "hello"},
+          {},
+          [&resumed](auto&& function) {
+            ++resumed;
+            function();
+          },
+          result,
+          wait);
+      wait->wait_notice();
+
+      expect(1 == resumed);
+      expect("hello\n" == result->get_stdout());
+    }
+
+    // process_reader
+
+    {
+      pqrs::process::process p(dispatcher,
+                               std::vector<std::string>{
+                                   "/bin/sh",
+                                   "-c",
+                                   "printf 'a\\nb\\n'; sleep 0.1; printf 'c\\n\\nd'; printf error >&2; sleep 0.1; printf more >&2",
+                               });
+      auto stdout_reader = std::make_shared<pqrs::process::process_reader>(dispatcher, p);
+      auto stderr_reader = std::make_shared<pqrs::process::process_reader>(dispatcher,
+                                                                            p,
+                                                                            pqrs::process::process_reader::stream::standard_error);
+      auto lines = std::make_shared<std::vector<std::string>>();
+      auto output = std::make_shared<std::string>();
+      const auto lines_wait = pqrs::make_thread_wait();
+      const auto output_wait = pqrs::make_thread_wait();
+
+      await_lines(stdout_reader, lines, lines_wait);
+      await_chunks(stderr_reader, output, output_wait);
+
+      p.run();
+      lines_wait->wait_notice();
+      output_wait->wait_notice();
+
+      expect(std::vector<std::string>{"a", "b", "c", "", "d"} == *lines);
+      expect("errormore" == *output);
+    }
+
+    dispatcher->terminate();
+    dispatcher = nullptr;
+  };
+
+  "coprocess"_test = [] {
+    auto time_source = std::make_shared<pqrs::dispatcher::hardware_time_source>();
+    auto dispatcher = std::make_shared<pqrs::dispatcher::dispatcher>(time_source);
+
+    // newline (pipelined)
+
+    {
+      pqrs::process::coprocess c(dispatcher,
+                                 std::vector<std::string>{"/bin/sh", "-c", "while read l; do echo \"r:$l\"; done"});
+
+      std::vector<std::future<std::optional<std::string>>> futures;
+      for (int i = 0; i < 100; ++i) {
+        futures.push_back(c.request(std::to_string(i)));
+      }
+
+      expect(c.run());
+
+      for (int i = 0; i < 100; ++i) {
+        expect("r:" + std::to_string(i) == futures[i].get());
+      }
+      expect(0 == c.get_pending_request_count());
+
+      // handler
+
+      std::vector<std::string> responses;
+      const auto wait = pqrs::make_thread_wait();
+      expect(c.request("a", [&](auto&& response) { responses.push_back(*response); }));
+      expect(c.request("b", [&](auto&& response) {
+        responses.push_back(*response);
+        wait->notify();
+      }));
+      wait->wait_notice();
+      expect(std::vector<std::string>{"r:a", "r:b"} == responses);
+
+      // A payload which contains the delimiter is rejected.
+      expect(!c.request("d\ne", [](auto&&) {}));
+      expect(std::nullopt == c.request("d\ne").get());
+      expect("r:f" == c.request("f").get());
+
+      c.close();
+      c.wait();
+      expect(!c.request("c").get());
+    }
+
+    // nul
+
+    {
+      pqrs::process::coprocess c(dispatcher,
+                                 std::vector<std::string>{"/bin/cat"},
+                                 pqrs::process::coprocess_framing::nul);
+      c.run();
+
+      auto f1 = c.request("hello\nworld");
+      auto f2 = c.request("");
+      expect("hello\nworld" == f1.get());
+      expect("" == f2.get());
+      expect(std::nullopt == c.request(std::string("a\0b", 3)).get());
+    }
+
+    // length_prefixed
+
+    {
+      pqrs::process::coprocess c(dispatcher,
+                                 std::vector<std::string>{"/bin/cat"},
+                                 pqrs::process::coprocess_framing::length_prefixed);
+      c.run();
+
+      const std::string large(256 * 1024, 'x');
+      const auto binary = std::string("a\0\nb", 4);
+      auto f1 = c.request(large);
+      auto f2 = c.request(binary);
+      auto f3 = c.request("");
+      expect(large == f1.get());
+      expect(binary == f2.get());
+      expect("" == f3.get());
+    }
+
+    // The pending requests fail when the process exits.
+
+    {
+      pqrs::process::coprocess c(dispatcher,
+                                 std::vector<std::string>{"/bin/sh", "-c", "read l; echo \"$l\"; exit 2"});
+
+      auto f1 = c.request("1");
+      auto f2 = c.request("2");
+      auto f3 = c.request("3");
+      c.run();
+
+      expect("1" == f1.get());
+      expect(std::nullopt == f2.get());
+      expect(std::nullopt == f3.get());
+      c.wait();
+      expect(0 == c.get_pending_request_count());
+    }
+
+    // The pending requests are completed when the coprocess is destroyed.
+
+    {
+      std::future<std::optional<std::string>> f;
+      {
+        pqrs::process::coprocess c(dispatcher,
+                                   std::vector<std::string>{"/bin/sleep", "10"});
+        c.run();
+        f = c.request("1");
+      }
+      expect(std::nullopt == f.get());
+    }
+
+    dispatcher->terminate();
+  };
+
+  "execute_many"_test = [] {
+    std::vector<std::vector<std::string>> commands;
+    for (int i = 0; i < 64; ++i) {
+      commands.push_back({
+          "/bin/sh",
+          "-c",
+          "echo " + std::to_string(i) + "; echo error" + std::to_string(i) + " >&2; exit " + std::to_string(i % 3),
+      });
+    }
+    commands.push_back({});
+
+    {
+      pqrs::process::execute_many e(commands,
+                                    pqrs::process::execute_many_options{
+                                        .concurrency = 8,
+                                    });
+
+      const auto& results = e.get_results();
+      expect(commands.size() == results.size());
+      for (int i = 0; i < 64; ++i) {
+        expect(std::to_string(i) + "\n" == results[i].get_stdout());
+        expect("error" + std::to_string(i) + "\n" == results[i].get_stderr());
+        expect(i % 3 == results[i].get_exit_code());
+        expect(!results[i].get_run_failed());
+      }
+      expect(results.back().get_run_failed());
+      expect(std::nullopt == results.back().get_exit_code());
+    }
+
+    // completion_handler
+
+    {
+      std::vector<int> counts(commands.size());
+      const auto thread_id = std::this_thread::get_id();
+      bool called_on_caller_thread = true;
+
+      pqrs::process::execute_many e(commands,
+                                    [&](auto&& index, auto&& result) {
+                                      ++counts[index];
+                                      called_on_caller_thread &= (std::this_thread::get_id() == thread_id);
+                                      if (index < 64) {
+                                        expect(std::to_string(index) + "\n" == result.take_stdout());
+                                      }
+                                    });
+
+      expect(std::ranges::all_of(counts, [](auto&& c) { return c == 1; }));
+      expect(called_on_caller_thread);
+      expect(e.get_results().empty());
+    }
+
+    // concurrency
+
+    {
+      const auto start = std::chrono::steady_clock::now();
+
+      pqrs::process::execute_many e(std::vector<std::vector<std::string>>(8, {"/bin/sleep", "0.2"}),
+                                    pqrs::process::execute_many_options{
+                                        .concurrency = 4,
+                                    });
+
+      const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+      expect(elapsed >= 400_l);
+      expect(elapsed < 1600_l);
     }
   };
 